@@ -0,0 +1,91 @@
+#include <stdlib.h>
+
+#include "array.h"
+#include "graph.h"
+#include "bench.h"
+
+/* array growth and the graph's edge lists, which are made of small arrays.
+ * the linear policy is timed alongside the geometric one for comparison
+ */
+
+#define NR_MEMBERS  (2000000)
+#define NR_VERTICES (200000)
+#define NR_EDGES    (2 * NR_VERTICES)
+#define NR_TINY     (200000)
+
+static void
+bench_append_pop (const char* name, enum array_growth_policy growth)
+{
+  auto start = bench$now ();
+  auto array = array$new (sizeof (uint64_t));
+  array$allocopts (
+    array,
+    (struct array_allocopts){ .growth = growth,
+                              .alloc_nmemb_increment = 4,
+                              .trim_nmemb_threshold = 8 });
+  for (uint64_t i = 0; i < NR_MEMBERS; i++)
+    array$append (array, &i);
+  while (!array$is_empty (array))
+    array$remove (array, array$length (array) - 1);
+  array$free (array);
+  printf (
+    "append + pop %d members (%s): %.3fs\n", NR_MEMBERS, name,
+    bench$now () - start);
+}
+
+static void
+bench_tiny (const char* name, size_t inline_nmemb)
+{
+  auto start = bench$now ();
+  for (size_t i = 0; i < NR_TINY; i++)
+  {
+    auto array = inline_nmemb
+      ? array$new_inline (sizeof (uint32_t), inline_nmemb)
+      : array$new (sizeof (uint32_t));
+    for (uint32_t j = 0; j < 3; j++)
+      array$append (array, &j);
+    array$free (array);
+  }
+  printf ("%d tiny %s arrays: %.3fs\n", NR_TINY, name, bench$now () - start);
+}
+
+/* every vertex gets two edges, visited in a scattered order. the edges are
+ * distinct, since STRICT builds assert against duplicates
+ */
+static void
+bench_graph (void)
+{
+  vertex_tag_t* tags = calloc (NR_VERTICES, sizeof (vertex_tag_t));
+
+  auto start = bench$now ();
+  auto graph = graph$new ();
+  for (size_t i = 0; i < NR_VERTICES; i++)
+    tags[i] = graph$add (graph, NULL);
+  auto added = bench$now ();
+
+  for (size_t i = 0; i < NR_EDGES; i++)
+  {
+    auto a = (i * 7919) % NR_VERTICES;
+    auto b = (a + 1 + (i / NR_VERTICES) * (NR_VERTICES / 2)) % NR_VERTICES;
+    digraph$connect (graph, tags[a], tags[b]);
+  }
+  auto connected = bench$now ();
+
+  printf ("add %d graph vertices: %.3fs\n", NR_VERTICES, added - start);
+  printf (
+    "%d vertices + %d edges: %.3fs\n", NR_VERTICES, NR_EDGES,
+    connected - start);
+  graph$free (graph);
+  free (tags);
+}
+
+int
+main (int argc, char** argv)
+{
+  bench_append_pop ("geometric", ARRAY_GROWTH_GEOMETRIC);
+  bench_append_pop ("linear", ARRAY_GROWTH_LINEAR);
+  bench_tiny ("heap", 0);
+  bench_tiny ("inline", 4);
+  bench_graph ();
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
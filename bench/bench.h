@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* shared helpers of the micro-benchmarks under bench/, build them with
+ * `make bench OPT=-O2` from a clean build directory, objects built at -O0
+ * aren't worth timing
+ */
+
+static inline double
+bench$now (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* xorshift64, deterministic so that runs are comparable */
+static inline uint64_t
+bench$rand (uint64_t* seed)
+{
+  auto x = *seed;
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *seed = x;
+}
+
+/* millions of operations per second */
+static inline double
+bench$mops (size_t count, double seconds)
+{
+  return (double)count / seconds / 1e6;
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+#include <capstone/capstone.h>
+#include <stdlib.h>
+
+#include "pe/context.h"
+#include "pe/format.h"
+#include "bench.h"
+
+/* decode throughput of both decoder tiers, a linear sweep over every
+ * executable section of an image:
+ *  - scan: detail off, what block discovery decodes with
+ *  - detail: detail on, what an instruction costs once its detail is needed
+ * undecodable bytes are skipped one at a time, like a linear disassembler
+ */
+
+#define DEFAULT_NR_PASSES (8)
+
+struct sweep_stats
+{
+  size_t insns, bytes;
+};
+
+static struct sweep_stats
+sweep (csh handle, const uint8_t* code, size_t code_size, uint64_t address)
+{
+  struct sweep_stats stats = { 0 };
+  auto insn = cs_malloc (handle);
+  while (code_size)
+  {
+    if (cs_disasm_iter (handle, &code, &code_size, &address, insn))
+    {
+      stats.insns++;
+      stats.bytes += insn->size;
+      continue;
+    }
+    code++;
+    code_size--;
+    address++;
+  }
+  cs_free (insn, 1);
+  return stats;
+}
+
+static void
+bench_tier (const char* name, csh handle, pe_context_t pe, size_t nr_passes)
+{
+  struct sweep_stats total = { 0 };
+  auto start = bench$now ();
+  for (size_t pass = 0; pass < nr_passes; pass++)
+  {
+    $array_for_each (
+      $, pe->section_headers, struct image_section_header, section)
+    {
+      if (!($.section->characteristics & IMAGE_SCN_MEM_EXECUTE))
+        continue;
+      uint64_t len;
+      auto code = pe$view_rva (pe, $.section->virtual_address, &len);
+      if (code == NULL)
+        continue;
+      auto size = $min (len, pe$get_section_virtual_size ($.section));
+      auto stats = sweep (handle, code, size, $.section->virtual_address);
+      total.insns += stats.insns;
+      total.bytes += stats.bytes;
+    }
+  }
+  auto seconds = bench$now () - start;
+
+  printf (
+    "%-6s %8.2f MB/s, %7.2f M insns/s (%zu insns, %zu bytes per pass)\n",
+    name, (double)total.bytes / seconds / 1e6,
+    bench$mops (total.insns, seconds), total.insns / nr_passes,
+    total.bytes / nr_passes);
+}
+
+/* `./decode IMAGE [PASSES]` */
+int
+main (int argc, char** argv)
+{
+  if (argc < 2)
+  {
+    fprintf (stderr, "usage: %s IMAGE [PASSES]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  size_t nr_passes = argc > 2
+    ? strtoull (argv[2], NULL, 0)
+    : DEFAULT_NR_PASSES;
+  if (!nr_passes)
+    nr_passes = 1;
+
+  auto file = fopen (argv[1], "rb");
+  if (file == NULL)
+  {
+    fprintf (stderr, "failed to open path: %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+  auto pe = pe$from_file (file, PE_CONTEXT_MAP_IMAGE);
+  if ((pe == NULL) || !pe$is_image_mapped (pe))
+  {
+    fprintf (stderr, "failed to map image: %s\n", argv[1]);
+    return EXIT_FAILURE;
+  }
+
+  csh scan_handle, detail_handle;
+  if ((cs_open (CS_ARCH_X86, CS_MODE_64, &scan_handle) != CS_ERR_OK)
+      || (cs_open (CS_ARCH_X86, CS_MODE_64, &detail_handle) != CS_ERR_OK))
+  {
+    fprintf (stderr, "failed to initialize Capstone\n");
+    return EXIT_FAILURE;
+  }
+  cs_option (detail_handle, CS_OPT_DETAIL, CS_OPT_ON);
+
+  bench_tier ("scan", scan_handle, pe, nr_passes);
+  bench_tier ("detail", detail_handle, pe, nr_passes);
+
+  cs_close (&scan_handle);
+  cs_close (&detail_handle);
+  pe$free (pe);
+  fclose (file);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include <stdlib.h>
+
+#include "cfg/cfg.h"
+#include "bench.h"
+
+/* a single function built from a chain of basic blocks, the way the
+ * generator grows one, then one metadata read per block
+ */
+
+#define FN_RVA       (0x1000ull)
+#define BLOCK_STRIDE (16ull)
+
+static const size_t g_block_counts[] = { 20000, 100000 };
+
+static void
+bench_graph (size_t nr_blocks)
+{
+  vertex_tag_t* tags = calloc (nr_blocks, sizeof (vertex_tag_t));
+
+  auto start = bench$now ();
+  auto cfg = cfg$new (0x140000000ull, FN_RVA + (nr_blocks + 1) * BLOCK_STRIDE);
+  auto fn_tag = cfg$add_function_block (cfg, FN_RVA);
+  tags[0] = cfg$add_basic_block (cfg, fn_tag, FN_RVA);
+  cfg$set_basic_block_end (cfg, fn_tag, tags[0], FN_RVA + BLOCK_STRIDE);
+  for (size_t i = 1; i < nr_blocks; i++)
+  {
+    auto address = FN_RVA + i * BLOCK_STRIDE;
+    tags[i] = cfg$add_basic_block_succ (cfg, fn_tag, tags[i - 1], address);
+    cfg$set_basic_block_end (cfg, fn_tag, tags[i], address + BLOCK_STRIDE);
+  }
+  auto built = bench$now ();
+
+  uint64_t total_size = 0;
+  for (size_t i = 0; i < nr_blocks; i++)
+    total_size += cfg$get_basic_block_size (cfg, fn_tag, tags[i]);
+  auto looked_up = bench$now ();
+
+  printf (
+    "%7zu blocks: build %.3fs, metadata lookups %.3fs (%" PRIu64 " bytes)\n",
+    nr_blocks, built - start, looked_up - built, total_size);
+  cfg$free (cfg);
+  free (tags);
+}
+
+/* `./graph [N]` only runs the first `N` block counts */
+int
+main (int argc, char** argv)
+{
+  size_t nr_runs = sizeof (g_block_counts) / sizeof (*g_block_counts);
+  if (argc > 1)
+    nr_runs = $min (nr_runs, strtoull (argv[1], NULL, 0));
+
+  for (size_t i = 0; i < nr_runs; i++)
+    bench_graph (g_block_counts[i]);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#include <stdlib.h>
+
+#include "map.h"
+#include "bench.h"
+
+/* insert and lookup throughput of map_t, keyed like the cfg keys it: rvas of
+ * 16-byte aligned blocks. lookups are random, so they aren't served from the
+ * cache by walking the table in order
+ */
+
+#define KEY_BASE   (0x140001000ull)
+#define KEY_STRIDE (16ull)
+
+static const size_t g_key_counts[] = { 1000, 100000, 10000000 };
+
+static void
+bench_map (size_t nr_keys)
+{
+  uint64_t seed = 88172645463325252ull;
+  auto map = map$new ();
+
+  auto start = bench$now ();
+  for (size_t i = 0; i < nr_keys; i++)
+    map$set (map, KEY_BASE + i * KEY_STRIDE, (void*)(i + 1));
+  auto inserted = bench$now ();
+
+  size_t hits = 0;
+  for (size_t i = 0; i < nr_keys; i++)
+  {
+    auto key = KEY_BASE + (bench$rand (&seed) % nr_keys) * KEY_STRIDE;
+    hits += map$get (map, key) != NULL;
+  }
+  auto looked_up = bench$now ();
+
+  printf (
+    "%9zu keys: insert %7.2f Mops/s, lookup %7.2f Mops/s (%zu hits)\n",
+    nr_keys, bench$mops (nr_keys, inserted - start),
+    bench$mops (nr_keys, looked_up - inserted), hits);
+  map$free (map);
+}
+
+/* `./map [N]` only runs the first `N` key counts */
+int
+main (int argc, char** argv)
+{
+  size_t nr_runs = sizeof (g_key_counts) / sizeof (*g_key_counts);
+  if (argc > 1)
+    nr_runs = $min (nr_runs, strtoull (argv[1], NULL, 0));
+
+  for (size_t i = 0; i < nr_runs; i++)
+    bench_map (g_key_counts[i]);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
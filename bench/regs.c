@@ -0,0 +1,42 @@
+#include <capstone/x86.h>
+#include <stdlib.h>
+
+#include "cfg/arch/x86.h"
+#include "bench.h"
+
+/* x86 register accesses through the descriptor table, over a mix of widths
+ * and aliases. each iteration is one set_reg, get_reg and get_reg_width
+ */
+
+#define NR_ITERS (50000000)
+
+static const uint16_t g_regs[] = {
+  X86_REG_RAX, X86_REG_ECX, X86_REG_R15, X86_REG_DL, X86_REG_R9D,
+  X86_REG_SI, X86_REG_AH
+};
+
+int
+main (int argc, char** argv)
+{
+  const size_t nr_regs = sizeof (g_regs) / sizeof (*g_regs);
+  auto state = cfg_sim$x86$new_state ();
+  uint64_t sum = 0;
+
+  auto start = bench$now ();
+  for (size_t i = 0; i < NR_ITERS; i++)
+  {
+    uint64_t mask, val;
+    auto reg = g_regs[i % nr_regs];
+    cfg_sim$x86$set_reg (state, reg, i);
+    if (cfg_sim$x86$get_reg (state, &mask, reg, &val))
+      sum += val & mask;
+    sum += cfg_sim$x86$get_reg_width (state, reg);
+  }
+  auto seconds = bench$now () - start;
+
+  printf (
+    "%d iterations: %.2f ns/iteration (%" PRIx64 ")\n", NR_ITERS,
+    seconds * 1e9 / NR_ITERS, sum);
+  cfg_sim$x86$free_state (state);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include <capstone/x86.h>
+#include <stdlib.h>
+
+#include "cfg/cfg.h"
+#include "cfg/cfg-ir.h"
+#include "cfg/cfg-sim.h"
+#include "bench.h"
+
+/* simulator throughput over a slice of the instructions dataflow slices are
+ * usually made of. build with `make bench CFG_SIM_X86_ONLY=1` to time the
+ * specialised handlers instead of the fnptr table
+ */
+
+#define FN_VA       (0x140001000ull)
+#define INSN_SIZE   (4)
+#define NR_REPEATS  (64)
+#define NR_ITERS    (200000)
+
+#define $op_reg(r, sz) \
+  ((struct cfg_ir_operand){ .type = CFG_IR_OP_REG, .size = (sz), .reg = (r) })
+#define $op_imm(v, sz) \
+  ((struct cfg_ir_operand){ .type = CFG_IR_OP_IMM, .size = (sz), .imm = (v) })
+#define $op_mem(b, d) \
+  ((struct cfg_ir_operand){ \
+    .type = CFG_IR_OP_MEM, .size = 8, .mem = { .base = (b), .disp = (d) } })
+
+struct bench_insn
+{
+  uint16_t id;
+  uint8_t op_count;
+  struct cfg_ir_operand operands[CFG_IR_MAX_OPERANDS];
+};
+
+static const struct bench_insn g_slice[] = {
+  { X86_INS_MOV, 2, { $op_reg (X86_REG_RAX, 8), $op_imm (5, 8) } },
+  { X86_INS_MOV, 2, { $op_reg (X86_REG_RBX, 8), $op_imm (7, 8) } },
+  { X86_INS_ADD, 2, { $op_reg (X86_REG_RAX, 8), $op_reg (X86_REG_RBX, 8) } },
+  { X86_INS_ADD, 2, { $op_reg (X86_REG_EAX, 4), $op_imm (3, 4) } },
+  { X86_INS_ROL, 2, { $op_reg (X86_REG_RAX, 8), $op_imm (3, 1) } },
+  { X86_INS_ADD, 2, { $op_reg (X86_REG_RBX, 8), $op_imm (9, 8) } },
+  { X86_INS_PUSH, 1, { $op_reg (X86_REG_RAX, 8) } },
+  { X86_INS_MOV, 2, { $op_reg (X86_REG_RCX, 8), $op_imm (0, 8) } },
+  { X86_INS_POP, 1, { $op_reg (X86_REG_RCX, 8) } },
+  { X86_INS_LEA, 2,
+    { $op_reg (X86_REG_RDX, 8), $op_mem (X86_REG_RSP, -0x20) } },
+  { X86_INS_MOV, 2, { $op_reg (X86_REG_R8, 8), $op_reg (X86_REG_RCX, 8) } },
+  { X86_INS_ADD, 2, { $op_reg (X86_REG_R8, 8), $op_reg (X86_REG_RAX, 8) } },
+  { X86_INS_ROR, 2, { $op_reg (X86_REG_R8, 8), $op_imm (1, 1) } },
+};
+
+/* appends `insn` through a single-row view over it, the IR can otherwise only
+ * be built from capstone instructions
+ */
+static void
+append_insn (cfg_ir_t ir, const struct bench_insn* insn, uint64_t address)
+{
+  uint16_t id = insn->id;
+  uint8_t size = INSN_SIZE, op_count = insn->op_count;
+  uint64_t no_regs = 0, no_flags = 0;
+  const char* mnemonic = "";
+  struct cfg_ir_operand operands[1][CFG_IR_MAX_OPERANDS]
+    = { { insn->operands[0], insn->operands[1] } };
+
+  struct _cfg_ir row = {
+    .length = 1,
+    .capacity = 1,
+    .address = &address,
+    .id = &id,
+    .size = &size,
+    .op_count = &op_count,
+    .operands = operands,
+    .regs_read = &no_regs,
+    .regs_written = &no_regs,
+    .flags_tested = &no_flags,
+    .flags_modified = &no_flags,
+    .mnemonic = &mnemonic
+  };
+  cfg_ir$append_row (ir, &row, 0);
+}
+
+int
+main (int argc, char** argv)
+{
+  const size_t nr_insns = sizeof (g_slice) / sizeof (*g_slice);
+  auto cfg = cfg$new (FN_VA & ~0xfffffull, 0x10000);
+  auto fn_tag = cfg$add_function_block (cfg, FN_VA);
+  cfg$set_function_block_sp_offset (cfg, fn_tag, 0x1000);
+
+  auto ir = cfg_ir$new ();
+  for (size_t i = 0; i < nr_insns * NR_REPEATS; i++)
+    append_insn (ir, &g_slice[i % nr_insns], FN_VA + i * INSN_SIZE);
+
+  auto sim = cfg_sim$new_context (cfg, CS_ARCH_X86);
+  auto start = bench$now ();
+  for (size_t i = 0; i < NR_ITERS; i++)
+  {
+    if (!cfg_sim$simulate_insns (sim, fn_tag, ir))
+    {
+      fprintf (stderr, "failed to simulate the slice\n");
+      return EXIT_FAILURE;
+    }
+  }
+  auto seconds = bench$now () - start;
+
+  uint64_t r8 = 0;
+  sim->fn.get_reg (sim->state, NULL, X86_REG_R8, &r8);
+  printf (
+    "%zu insns x %d: %.1f M insns/s (r8 = %" PRIx64 ")\n",
+    cfg_ir$length (ir), NR_ITERS,
+    bench$mops (cfg_ir$length (ir) * NR_ITERS, seconds), r8);
+
+  cfg_sim$free (sim);
+  cfg_ir$free (ir);
+  cfg$free (cfg);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "generic.h"
+
+/* a region allocator, everything allocated from an arena is released at once
+ * by `arena$free`. all `arena$*` allocation functions accept a NULL arena, in
+ * which case they fall back to the regular heap so that containers can be
+ * written once for both
+ */
+typedef struct _arena *arena_t;
+
+void arena$free (arena_t);
+
+__attribute__ (( malloc(arena$free, 1) ))
+arena_t arena$new (void);
+
+void* arena$alloc (arena_t, size_t size);
+void* arena$realloc (arena_t, void* ptr, size_t old_size, size_t new_size);
+void arena$dealloc (arena_t, void* ptr);
+size_t arena$get_size (arena_t);
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <string.h>
 
+#include "arena.h"
 #include "generic.h"
 
 typedef struct _array *array_t;
@@ -9,10 +10,26 @@ typedef struct _array *array_t;
 typedef typeof (memcpy)* array_memcpy_fn_t;
 typedef typeof (memmove)* array_memmove_fn_t;
 typedef typeof (free)* array_free_fn_t;
+typedef int (*array_compare_fn_t)(const void*, const void*);
+
+enum array_growth_policy
+{
+  /* capacity at least doubles when met, and is halved once three quarters of
+   * it is unused, so appends and removals are amortised O(1)
+   */
+  ARRAY_GROWTH_GEOMETRIC = 0,
+  /* capacity grows by `alloc_nmemb_increment` and is trimmed by
+   * `trim_nmemb_threshold` members at a time
+   */
+  ARRAY_GROWTH_LINEAR
+};
 
 struct array_allocopts
 { 
-  /* size (in members) by which to grow when capacity is met.
+  enum array_growth_policy growth;
+
+  /* size (in members) by which to grow when capacity is met, this is the
+   * minimum step under geometric growth.
    * cannot be zero, unless the array is a tuple
    */
   size_t alloc_nmemb_increment;
@@ -55,6 +72,16 @@ void array$free (array_t);
 __attribute__ (( malloc(array$free, 1) ))
 array_t array$new (size_t membsize);
 __attribute__ (( malloc(array$free, 1) ))
+array_t array$new_in (arena_t, size_t membsize);
+/* the first `inline_nmemb` members are stored inside the array object itself,
+ * so small arrays need no separate buffer allocation
+ */
+__attribute__ (( malloc(array$free, 1) ))
+array_t array$new_inline (size_t membsize, size_t inline_nmemb);
+__attribute__ (( malloc(array$free, 1) ))
+array_t array$new_inline_in (
+  arena_t, size_t membsize, size_t inline_nmemb);
+__attribute__ (( malloc(array$free, 1) ))
 array_t array$from_existing (void* ptr, size_t n, size_t membsize);
 
 void* array$append (array_t, void* ptrmemb);
@@ -64,7 +91,9 @@ void array$remove (array_t, size_t idx);
 void array$remove_rval (array_t, uintmax_t memb);
 void array$remove_lval (array_t array, void* memb);
 void array$pop (array_t, void* into, size_t idx);
+void array$clear (array_t);
 void array$concat (array_t, array_t other);
+void array$sort (array_t, array_compare_fn_t compare);
 void* array$at (array_t, size_t idx);
 
 size_t array$length (array_t);
@@ -14,4 +14,8 @@ void bitmap$set_range (bitmap_t, size_t start, size_t end);
 bool bitmap$test (bitmap_t, size_t idx);
 bool bitmap$test_any_in_range (bitmap_t, size_t start, size_t end);
 bool bitmap$test_all_in_range (bitmap_t, size_t start, size_t end);
+/* both return `end` if no such bit exists in [start, end) */
+size_t bitmap$find_first_set (bitmap_t, size_t start, size_t end);
+size_t bitmap$find_first_clear (bitmap_t, size_t start, size_t end);
+size_t bitmap$popcount_range (bitmap_t, size_t start, size_t end);
 size_t bitmap$get_size (bitmap_t bitmap);
\ No newline at end of file
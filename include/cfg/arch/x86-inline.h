@@ -0,0 +1,170 @@
+#pragma once
+
+#include <string.h>
+
+#include "generic.h"
+#include "cfg/arch/x86.h"
+
+/* the x86 state operations proper, on a typed state. each exported
+ * `cfg_sim$x86$*` function wraps its `cfg_sim$x86$inline_*` counterpart for
+ * the fnptr table, and the specialised simulator (`CFG_SIM_X86_ONLY`) calls
+ * these directly so that they inline into the instruction handlers
+ */
+
+static inline const struct cfg_sim_x86_reg_desc*
+cfg_sim$x86$inline_get_reg_desc_chk (enum x86_reg reg)
+{
+  auto desc = $cfg_sim_x86_reg_desc (reg);
+  if (desc == NULL)
+  {
+    /* this might be valid in some cases? */
+    if (reg == X86_REG_INVALID)
+      $abort ("tried to get location of invalid register");
+    $abort ("unrecognised x86 register: %d", reg);
+  }
+  return desc;
+}
+
+static inline uint64_t*
+cfg_sim$x86$inline_get_regloc_mask (
+  struct cfg_sim_state_x86* state, enum x86_reg reg, uint64_t* mask)
+{
+  auto desc = cfg_sim$x86$inline_get_reg_desc_chk (reg);
+  if (mask != NULL)
+    *mask = desc->mask;
+  return &state->gpregs[desc->slot];
+}
+
+static inline bool
+cfg_sim$x86$inline_is_dirty_bit_set (
+  struct cfg_sim_state_x86* state, uint64_t* regloc)
+{
+  $strict_assert (
+    (state->gpregs <= regloc)
+      && (regloc < (state->gpregs + $arraysize (state->gpregs))),
+    "Invalid register location");
+  return state->bitmap_gpregs & (1ull << (regloc - state->gpregs));
+}
+
+static inline void
+cfg_sim$x86$inline_set_dirty_bit (
+  struct cfg_sim_state_x86* state, uint64_t* regloc)
+{
+  $strict_assert (
+    (state->gpregs <= regloc)
+      && (regloc < (state->gpregs + $arraysize (state->gpregs))),
+    "Invalid register location");
+  state->bitmap_gpregs |= 1ull << (regloc - state->gpregs);
+}
+
+static inline bool
+cfg_sim$x86$inline_get_reg (
+  struct cfg_sim_state_x86* state, uint64_t* mask, uint16_t reg,
+  uint64_t* val)
+{
+  auto desc = cfg_sim$x86$inline_get_reg_desc_chk ((enum x86_reg)reg);
+  auto regloc = &state->gpregs[desc->slot];
+  if (!cfg_sim$x86$inline_is_dirty_bit_set (state, regloc))
+    return false;
+  if (mask != NULL)
+    *mask = desc->mask >> desc->shift;
+  *val = (*regloc & desc->mask) >> desc->shift;
+  return true;
+}
+
+static inline void
+cfg_sim$x86$inline_set_reg (
+  struct cfg_sim_state_x86* state, uint16_t reg, uint64_t val)
+{
+  auto desc = cfg_sim$x86$inline_get_reg_desc_chk ((enum x86_reg)reg);
+  auto regloc = &state->gpregs[desc->slot];
+
+  /* NB: writing to 32-bit registers clears the upper 32 bits of the 64-bit
+   *     variant
+   */
+  if (desc->mask == REGMASK_DWORD)
+    *regloc = val & REGMASK_DWORD;
+  else
+    *regloc = (*regloc & ~desc->mask) | ((val << desc->shift) & desc->mask);
+
+  cfg_sim$x86$inline_set_dirty_bit (state, regloc);
+}
+
+static inline uint8_t
+cfg_sim$x86$inline_get_reg_width (uint16_t reg)
+{
+  return cfg_sim$x86$inline_get_reg_desc_chk ((enum x86_reg)reg)->width;
+}
+
+static inline uint8_t*
+cfg_sim$x86$inline_get_stack_frame (struct cfg_sim_state_x86* state)
+{
+  return *(uint8_t **)cfg_sim$x86$inline_get_regloc_mask (
+    state, X86_REG_RSP, NULL);
+}
+
+static inline void
+cfg_sim$x86$inline_push_stack (
+  struct cfg_sim_state_x86* state, void* ptr, size_t size)
+{
+  auto stack = cfg_sim$x86$inline_get_stack_frame (state);
+  stack = memcpy (stack - size, ptr, size);
+  cfg_sim$x86$inline_set_reg (state, X86_REG_RSP, (uintptr_t)stack);
+}
+
+static inline void
+cfg_sim$x86$inline_pop_stack (
+  struct cfg_sim_state_x86* state, void* dst, size_t size)
+{
+  auto stack = cfg_sim$x86$inline_get_stack_frame (state);
+  memcpy (dst, stack, size);
+  cfg_sim$x86$inline_set_reg (state, X86_REG_RSP, (uintptr_t)(stack + size));
+}
+
+static inline void
+cfg_sim$x86$inline_set_flag (
+  struct cfg_sim_state_x86* state, uint64_t mask, bool val)
+{
+  state->lazy_flags &= ~mask;
+  if (val)
+    state->flags |= mask;
+  else
+    state->flags &= ~mask;
+}
+
+static inline uint64_t
+cfg_sim$x86$inline_get_cc_flags (const struct cfg_sim_cc* cc)
+{
+  switch (cc->op)
+  {
+    case CFG_SIM_CC_ADD:
+    case CFG_SIM_CC_SUB:
+    case CFG_SIM_CC_INC:
+    case CFG_SIM_CC_DEC:
+      return EFLAGS_ZF | EFLAGS_SF | EFLAGS_PF | EFLAGS_OF | EFLAGS_AF
+        | (((cc->op == CFG_SIM_CC_ADD) || (cc->op == CFG_SIM_CC_SUB))
+            ? EFLAGS_CF : 0);
+    case CFG_SIM_CC_LOGIC:
+      return EFLAGS_ZF | EFLAGS_SF | EFLAGS_PF | EFLAGS_CF | EFLAGS_OF;
+    case CFG_SIM_CC_SHL:
+    case CFG_SIM_CC_SHR:
+      return EFLAGS_ZF | EFLAGS_SF | EFLAGS_PF | EFLAGS_CF
+        | ((cc->src_1 == 1) ? EFLAGS_OF : 0);
+    default:
+      return 0;
+  }
+}
+
+static inline void
+cfg_sim$x86$inline_set_flags_lazy (
+  struct cfg_sim_state_x86* state, const struct cfg_sim_cc* cc)
+{
+  auto defined = cfg_sim$x86$inline_get_cc_flags (cc);
+  /* flags the previous operation defined but this one doesn't keep their
+   * old values, so they have to be materialised before `cc` is replaced
+   */
+  if (state->lazy_flags & ~defined)
+    (void)cfg_sim$x86$get_flags (state, state->lazy_flags & ~defined);
+  state->cc = *cc;
+  state->lazy_flags |= defined;
+}
\ No newline at end of file
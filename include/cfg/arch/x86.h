@@ -1,22 +1,73 @@
 #pragma once
 
+#include <capstone/capstone.h>
 #include <stdint.h>
 
 #include "generic.h"
+#include "cfg/cfg-sim.h"
 
 #define CFG_SIM_X86_NREGS (17)
 
+/* canonical register bits, one per gp. register slot regardless of the
+ * width accessed. every register that isn't a gp. register or eflags shares
+ * the last bit
+ */
+#define CFG_SIM_X86_REGBIT_EFLAGS (1ull << CFG_SIM_X86_NREGS)
+#define CFG_SIM_X86_REGBIT_OTHER  (1ull << 63)
+
 #define REGMASK_LOWB  (0x00ff)
 #define REGMASK_HIGHB (0xff00)
 #define REGMASK_WORD  (0xffff)
 #define REGMASK_DWORD (0xffffffff)
 #define REGMASK_QWORD (0xffffffffffffffff)
 
+#define REGWIDTH_LOWB  (8)
+#define REGWIDTH_HIGHB (8)
+#define REGWIDTH_WORD  (16)
+#define REGWIDTH_DWORD (32)
+#define REGWIDTH_QWORD (64)
+
+#define REGSHIFT_LOWB  (0)
+#define REGSHIFT_HIGHB (8)
+#define REGSHIFT_WORD  (0)
+#define REGSHIFT_DWORD (0)
+#define REGSHIFT_QWORD (0)
+
+/* everything the simulator needs to know about a register, so that a
+ * register access is a single table lookup
+ */
+struct cfg_sim_x86_reg_desc
+{
+  /* bits of the gp. register slot the register aliases */
+  uint64_t mask;
+  uint8_t slot;
+  uint8_t width;
+  /* position of the register's lowest bit in the slot */
+  uint8_t shift;
+  bool is_valid;
+};
+
+extern const struct cfg_sim_x86_reg_desc cfg_sim$x86$reg_descs[X86_REG_ENDING];
+
+/* NULL if `reg` isn't modelled by the simulator */
+#define $cfg_sim_x86_reg_desc(reg) \
+  ({ \
+    auto _reg_idx = (reg); \
+    const struct cfg_sim_x86_reg_desc* _desc = NULL; \
+    if ((_reg_idx < X86_REG_ENDING) \
+        && cfg_sim$x86$reg_descs[_reg_idx].is_valid) \
+      _desc = &cfg_sim$x86$reg_descs[_reg_idx]; \
+    _desc; \
+  })
+
 struct cfg_sim_state_x86
 {
   uint64_t gpregs[CFG_SIM_X86_NREGS];
   uint64_t bitmap_gpregs : CFG_SIM_X86_NREGS;
   uint64_t flags;
+  /* flags in `lazy_flags` are stale in `flags`, and derive from `cc` */
+  uint64_t lazy_flags;
+  struct cfg_sim_cc cc;
 };
 
 void cfg_sim$x86$free_state (void* state);
@@ -25,14 +76,17 @@ __attribute__ (( malloc(cfg_sim$x86$free_state, 1) ))
 void* cfg_sim$x86$new_state (void);
 
 void cfg_sim$x86$reset (void* state);
-uint64_t* cfg_sim$x86$get_reg (void* state, uint64_t* mask, uint16_t reg);
+bool cfg_sim$x86$get_reg (
+  void* state, uint64_t* mask, uint16_t reg, uint64_t* val);
 uint64_t* cfg_sim$x86$get_reg_indet (void* state, uint64_t* mask, uint16_t reg);
+uint64_t cfg_sim$x86$get_reg_bit (uint16_t reg);
 const char* cfg_sim$x86$get_reg_name (void* state, uint16_t reg);
-uint64_t cfg_sim$x86$get_flags (void* state);
+uint64_t cfg_sim$x86$get_flags (void* state, uint64_t mask);
 uint8_t cfg_sim$x86$get_reg_width (void* state, uint16_t reg);
 uint8_t* cfg_sim$x86$get_stack_frame (void* state);
 void cfg_sim$x86$push_stack (void* _state, void* ptr, size_t size);
 void cfg_sim$x86$pop_stack (void* _state, void* dst, size_t size);
 void cfg_sim$x86$set_reg (void* state, uint16_t reg, uint64_t val);
 void cfg_sim$x86$set_pc (void* state, uint64_t val);
-void cfg_sim$x86$set_flag (void* state, uint64_t mask, bool val);
\ No newline at end of file
+void cfg_sim$x86$set_flag (void* state, uint64_t mask, bool val);
+void cfg_sim$x86$set_flags_lazy (void* state, const struct cfg_sim_cc* cc);
\ No newline at end of file
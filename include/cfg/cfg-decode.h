@@ -0,0 +1,59 @@
+#pragma once
+
+#include <capstone/capstone.h>
+
+#include "pe/context.h"
+#include "array.h"
+
+/* address-keyed cache of decoded instructions, every instruction is decoded
+ * at most once and stays at a stable address until the cache is freed.
+ *
+ * instructions are first decoded without detail, which is enough to find
+ * block boundaries. `cfg_decode$detail` decodes the detail of an instruction
+ * on demand, only once it is actually needed
+ */
+typedef struct _cfg_decode_cache *cfg_decode_cache_t;
+
+enum cfg_branch_kind
+{
+  CFG_BRANCH_NONE = 0,
+  CFG_BRANCH_JUMP,
+  CFG_BRANCH_CALL,
+  CFG_BRANCH_RET
+};
+
+struct cfg_decode_stats
+{
+  /* instructions served from the cache, and runs decoded on a miss */
+  size_t hits, misses;
+  /* instructions and bytes decoded by the detail-free scan */
+  size_t insns_decoded, bytes_decoded;
+  size_t details_decoded;
+};
+
+void cfg_decode$free (cfg_decode_cache_t);
+
+/* `scan_handle` should have `CS_OPT_DETAIL` off and `detail_handle` on, both
+ * are borrowed
+ */
+__attribute__ (( malloc(cfg_decode$free, 1) ))
+cfg_decode_cache_t cfg_decode$new (
+  pe_context_t, csh scan_handle, csh detail_handle);
+
+/* returns NULL if no valid instruction can be decoded at `address` */
+const cs_insn* cfg_decode$insn_at (cfg_decode_cache_t, uint64_t address);
+const cs_insn* cfg_decode$next (cfg_decode_cache_t, const cs_insn* insn);
+/* `insn` must come from the cache, returns it with `detail` populated or NULL
+ * if it isn't cached or its detail can't be decoded
+ */
+const cs_insn* cfg_decode$detail (cfg_decode_cache_t, const cs_insn* insn);
+enum cfg_branch_kind cfg_decode$get_branch_kind (const cs_insn* insn);
+
+/* appends the instructions covering [start, end) to `into` as
+ * `const cs_insn*`, false if the range doesn't decode up to `end` exactly
+ */
+bool cfg_decode$read_range (
+  cfg_decode_cache_t, uint64_t start, uint64_t end, bool with_detail,
+  array_t into);
+
+struct cfg_decode_stats cfg_decode$get_stats (cfg_decode_cache_t);
\ No newline at end of file
@@ -4,7 +4,9 @@
 
 #include "pe/context.h"
 #include "cfg/cfg.h"
+#include "cfg/cfg-decode.h"
 
+/* default for `cfg_gen$set_max_df_depth` */
 #define MAX_DF_BLOCK_DEPTH (16)
 
 typedef struct _cfg_gen_ctx *cfg_gen_ctx_t;
@@ -12,10 +14,29 @@ typedef struct _cfg_gen_ctx *cfg_gen_ctx_t;
 void cfg_gen$free_context (cfg_gen_ctx_t);
 
 __attribute__(( malloc(cfg_gen$free_context, 1) ))
+/* `scan_handle` is used with `CS_OPT_DETAIL` off to find block boundaries,
+ * `handle` with it on for everything else
+ */
 cfg_gen_ctx_t cfg_gen$new_context (
-  pe_context_t pe_context, cfg_t cfg, csh handle);
+  pe_context_t pe_context, cfg_t cfg, csh scan_handle, csh handle);
 
-bool cfg_gen$recurse_function_block (
+/* queues the function at `block_address` for generation, as a callee of
+ * `fn_pred` if non-zero
+ */
+void cfg_gen$queue_function_block (
   cfg_gen_ctx_t ctx, vertex_tag_t fn_pred, uint64_t block_address);
-bool cfg_gen$recurse_branch_insns (
-  cfg_gen_ctx_t ctx, cs_insn* branch_insn, vertex_tag_t pred);
\ No newline at end of file
+/* generates queued functions, and everything reachable from them, until no
+ * work is left. false if any block failed, the rest are still generated
+ */
+bool cfg_gen$generate (cfg_gen_ctx_t ctx);
+
+/* with `defer` set, callees found by `cfg_gen$generate` are collected rather
+ * than generated, so that a scheduler can hand them to other generators
+ */
+void cfg_gen$set_defer_callees (cfg_gen_ctx_t ctx, bool defer);
+/* false once no deferred callees are left */
+bool cfg_gen$pop_deferred_callee (
+  cfg_gen_ctx_t ctx, vertex_tag_t* fn_pred, uint64_t* address);
+
+void cfg_gen$set_max_df_depth (cfg_gen_ctx_t ctx, size_t depth);
+struct cfg_decode_stats cfg_gen$get_decode_stats (cfg_gen_ctx_t ctx);
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <capstone/capstone.h>
+
+#include "generic.h"
+
+/* compact instruction IR for dataflow slices, lowered once from capstone so
+ * that the slicer and the simulator never have to carry a `cs_detail` around.
+ *
+ * the IR is stored as a struct of arrays, row `i` of every column describes
+ * the `i`th instruction of the slice. rows are only ever appended
+ */
+#define CFG_IR_MAX_OPERANDS (2)
+
+enum cfg_ir_op_type
+{
+  CFG_IR_OP_INVALID = 0,
+  CFG_IR_OP_REG,
+  CFG_IR_OP_IMM,
+  CFG_IR_OP_MEM
+};
+
+struct cfg_ir_mem
+{
+  uint16_t segment, base, index, scale;
+  int64_t disp;
+};
+
+/* an abstract memory location, normalised from a memory operand so that
+ * equal locations compare (and hash) equal as plain integers:
+ *  - stack slots, [rsp/rbp + disp]: the frame register and displacement
+ *  - globals, [rip + disp]: the rva addressed
+ *  - anything else: every field of the operand, packed
+ * never zero
+ */
+typedef uint64_t cfg_memloc_t;
+
+enum cfg_memloc_kind
+{
+  CFG_MEMLOC_STACK = 1,
+  CFG_MEMLOC_GLOBAL,
+  CFG_MEMLOC_OTHER
+};
+
+struct cfg_ir_operand
+{
+  uint8_t type; /* enum cfg_ir_op_type */
+  uint8_t size;
+  union
+  {
+    uint16_t reg;
+    int64_t imm;
+    struct cfg_ir_mem mem;
+  };
+};
+
+struct _cfg_ir
+{
+  size_t length, capacity;
+
+  uint64_t* address;
+  uint16_t* id;
+  uint8_t* size;
+  /* NB: the real operand count, only the first `CFG_IR_MAX_OPERANDS` operands
+   *     are described in `operands`
+   */
+  uint8_t* op_count;
+  struct cfg_ir_operand (*operands)[CFG_IR_MAX_OPERANDS];
+  /* canonical register masks, see `cfg_sim$x86$get_reg_bit` */
+  uint64_t* regs_read;
+  uint64_t* regs_written;
+  /* `EFLAGS_*` masks */
+  uint64_t* flags_tested;
+  uint64_t* flags_modified;
+  /* borrowed from the decode cache, only used for tracing */
+  const char** mnemonic;
+};
+
+typedef struct _cfg_ir *cfg_ir_t;
+
+void cfg_ir$free (cfg_ir_t);
+
+__attribute__ (( malloc(cfg_ir$free, 1) ))
+cfg_ir_t cfg_ir$new (void);
+
+size_t cfg_ir$length (cfg_ir_t);
+bool cfg_ir$is_empty (cfg_ir_t);
+
+/* lowers `insn`, which must have its detail populated, and appends it as a
+ * new row. `handle` must have `CS_OPT_DETAIL` on
+ */
+bool cfg_ir$append_insn (cfg_ir_t, csh handle, const cs_insn* insn);
+/* appends a copy of row `idx` of `src` */
+void cfg_ir$append_row (cfg_ir_t, cfg_ir_t src, size_t idx);
+/* reverses the rows in place, slices are built back to front */
+void cfg_ir$reverse (cfg_ir_t);
+void cfg_ir$clear (cfg_ir_t);
+
+/* normalises memory operand `op` of row `idx`, false if the operand isn't a
+ * memory operand or can't be represented exactly
+ */
+bool cfg_ir$get_memloc (cfg_ir_t, size_t idx, uint8_t op, cfg_memloc_t* out);
+enum cfg_memloc_kind cfg_ir$get_memloc_kind (cfg_memloc_t);
+
+uint64_t cfg_ir$get_tested_flags (const cs_insn* insn);
+uint64_t cfg_ir$get_modified_flags (const cs_insn* insn);
\ No newline at end of file
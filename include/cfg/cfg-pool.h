@@ -0,0 +1,29 @@
+#pragma once
+
+#include "pe/context.h"
+#include "cfg/cfg.h"
+#include "cfg/cfg-decode.h"
+
+/* generates a cfg with several threads, one function at a time each. every
+ * worker owns its capstone handles, generator and simulator, only the cfg
+ * and the queue of functions left to generate are shared
+ */
+typedef struct _cfg_pool *cfg_pool_t;
+
+void cfg_pool$free (cfg_pool_t);
+
+__attribute__ (( malloc(cfg_pool$free, 1) ))
+/* NULL unless the image is mapped, workers only ever read it through views
+ * since the stream can't be shared between them
+ */
+cfg_pool_t cfg_pool$new (pe_context_t pe_context, cfg_t cfg, size_t jobs);
+
+void cfg_pool$queue_function_block (cfg_pool_t, uint64_t address);
+/* generates queued functions and all their callees, false if any block
+ * failed to generate
+ */
+bool cfg_pool$generate (cfg_pool_t);
+
+void cfg_pool$set_max_df_depth (cfg_pool_t, size_t depth);
+/* summed over every worker */
+struct cfg_decode_stats cfg_pool$get_decode_stats (cfg_pool_t);
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include <capstone/capstone.h>
 
 #include "cfg/cfg.h"
+#include "cfg/cfg-ir.h"
 #include "array.h"
 
 #define EFLAGS_CF (1ull << 0)
@@ -15,16 +16,44 @@
 #define EFLAGS_DF (1ull << 10)
 #define EFLAGS_OF (1ull << 11)
 
+/* flag-producing operations, whose flags are only computed once asked for */
+enum cfg_sim_cc_op
+{
+  CFG_SIM_CC_NONE = 0,
+  CFG_SIM_CC_ADD,
+  CFG_SIM_CC_SUB,
+  CFG_SIM_CC_LOGIC,
+  CFG_SIM_CC_INC,
+  CFG_SIM_CC_DEC,
+  CFG_SIM_CC_SHL,
+  CFG_SIM_CC_SHR
+};
+
+/* the last flag-producing operation, `result` is already masked to `width`.
+ * the meaning of the sources depends on the operation:
+ *  - add/sub: both operands
+ *  - inc/dec: `src_1` is the old value
+ *  - shl/shr: `src_1` is the shift count, `src_2` the last bit shifted out
+ */
+struct cfg_sim_cc
+{
+  uint8_t op; /* enum cfg_sim_cc_op */
+  uint8_t width;
+  uint64_t result, src_1, src_2;
+};
+
 struct cfg_sim_ctx_fnptrs
 {
   void* (*new_state)(void);
   void (*free_state)(void* state);
   void (*reset)(void* state);
 
-  /* get_reg: returns a pointer to the register location, otherwise NULL
-   *          if the value is yet indeterminate given the initial context
+  /* get_reg: reads the register's value into `val`, shifted down to bit 0
+   *          (ah reads as a byte, like al), and its width as a mask into
+   *          `mask`. false if the value is yet indeterminate given the
+   *          initial context
    */
-  uint64_t* (*get_reg)(void* state, uint64_t* mask, uint16_t reg);
+  bool (*get_reg)(void* state, uint64_t* mask, uint16_t reg, uint64_t* val);
 
   /* get_reg_indet: return pointer to the register location, only NULL if
    *                the register ID is invalid
@@ -33,22 +62,29 @@ struct cfg_sim_ctx_fnptrs
 
   uint8_t (*get_reg_width)(void* state, uint16_t reg);
   const char* (*get_reg_name)(void* state, uint16_t reg);
-  uint64_t (*get_flags)(void* state);
+  /* get_flags: only the flags in `mask` are guaranteed to be materialised */
+  uint64_t (*get_flags)(void* state, uint64_t mask);
   uint8_t* (*get_stack_frame)(void* state);
   void (*push_stack)(void* state, void* ptr, size_t size);
   void (*pop_stack)(void* state, void* dst, size_t size);
   void (*set_reg)(void* state, uint16_t reg, uint64_t val);
   void (*set_pc)(void* state, uint64_t val);
   void (*set_flag)(void* state, uint64_t mask, bool to);
+  /* set_flags_lazy: records `cc` as the source of the flags it defines */
+  void (*set_flags_lazy)(void* state, const struct cfg_sim_cc* cc);
 };
 
 struct _cfg_sim_ctx
 {
-  array_t /* struct cs_insn */ insns;
   void* state;
   vertex_tag_t fn_tag;
   cfg_t cfg;
   struct cfg_sim_ctx_fnptrs fn;
+  /* scratch stack frame of the function being simulated, owned by the
+   * context so that simulators never share one
+   */
+  uint8_t* stack_frame;
+  size_t stack_frame_capacity;
 };
 
 typedef struct _cfg_sim_ctx *cfg_sim_ctx_t;
@@ -59,4 +95,4 @@ __attribute__ (( malloc (cfg_sim$free, 1) ))
 cfg_sim_ctx_t cfg_sim$new_context (cfg_t cfg, cs_arch arch);
 
 bool cfg_sim$simulate_insns (
-  cfg_sim_ctx_t, vertex_tag_t fn_tag, array_t /* struct cs_insn */ insns);
+  cfg_sim_ctx_t, vertex_tag_t fn_tag, cfg_ir_t insns);
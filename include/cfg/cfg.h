@@ -5,11 +5,42 @@
 
 typedef struct _cfg *cfg_t;
 
+#define CFG_SUMMARY_NREGS (64)
+
+/* def/use summary of a basic block, register masks use the canonical
+ * register bits of the architecture (see `cfg_sim$x86$get_reg_bit`)
+ */
+struct cfg_block_summary
+{
+  /* registers written anywhere in the block, and registers read before the
+   * block writes them
+   */
+  uint64_t regs_defined, regs_used;
+  /* `EFLAGS_*` mask */
+  uint64_t flags_modified;
+  /* instructions loading from and storing to a memory operand */
+  size_t mem_loads, mem_stores;
+  /* index + 1 of the last instruction defining each register bit, or 0 if
+   * the block never defines it
+   */
+  uint16_t last_def[CFG_SUMMARY_NREGS];
+};
+
 void cfg$free (cfg_t);
 
 __attribute__ (( malloc(cfg$free, 1) ))
-cfg_t cfg$new (uint64_t image_base, size_t executable_size);
+cfg_t cfg$new (uint64_t image_base, size_t image_size);
+
+/* every `cfg$*` function takes the cfg's lock while `is_concurrent` is set,
+ * so that different threads may generate different functions at once. a
+ * function's blocks must still only be touched by one thread at a time
+ */
+void cfg$set_concurrent (cfg_t, bool is_concurrent);
 
+/* adding a function claims its address, 0 if a function already starts
+ * there, in which case nothing is added. `cfg$add_function_block_succ` still
+ * connects `fn_tag` to the existing function
+ */
 vertex_tag_t cfg$add_function_block (cfg_t, uint64_t address);
 vertex_tag_t cfg$add_function_block_succ (
   cfg_t, vertex_tag_t fn_tag, uint64_t address);
@@ -23,6 +54,9 @@ uint64_t cfg$get_basic_block_rva (
   cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag);
 uint64_t cfg$get_basic_block_size (
   cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag);
+/* NULL if the block has no up-to-date summary */
+const struct cfg_block_summary* cfg$get_basic_block_summary (
+  cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag);
 
 vertex_tag_t cfg$split_basic_block (
   cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag, uint64_t address);
@@ -31,14 +65,19 @@ void cfg$connect_basic_blocks (
 
 void cfg$set_basic_block_end (
   cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag, uint64_t address);
+/* the summary is copied, and dropped whenever the block's bounds change */
+void cfg$set_basic_block_summary (
+  cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag,
+  const struct cfg_block_summary* summary);
 void cfg$set_function_block_sp_offset (
   cfg_t, vertex_tag_t fn_tag, uint64_t offset);
+uint64_t cfg$get_function_block_sp_offset (cfg_t, vertex_tag_t fn_tag);
 
 bool cfg$is_address_visited (cfg_t, uint64_t address);
 
-__attribute__(( malloc(array$free, 1) ))
 array_t cfg$get_preds (cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag);
 array_t cfg$get_succs (cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag);
-
-uint8_t* cfg$new_stack_frame (cfg_t, vertex_tag_t fn_tag);
-void cfg$free_stack_frame (cfg_t, vertex_tag_t fn_tag);
\ No newline at end of file
+/* dense index of a basic block within its function, below the block count */
+size_t cfg$get_basic_block_slot (
+  cfg_t, vertex_tag_t fn_tag, vertex_tag_t basic_tag);
+size_t cfg$get_basic_block_count (cfg_t, vertex_tag_t fn_tag);
\ No newline at end of file
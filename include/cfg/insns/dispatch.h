@@ -3,12 +3,56 @@
 #include <capstone/capstone.h>
 
 #include "generic.h"
+#include "cfg/cfg-ir.h"
+
+/* state operations for the instruction handlers. these go through the
+ * context's fnptr table, unless the simulator is specialised for x86 with
+ * `CFG_SIM_X86_ONLY`, in which case they're direct calls on the x86 state
+ */
+#ifdef CFG_SIM_X86_ONLY
+#include "cfg/arch/x86-inline.h"
+
+#define $sim_x86_state(sim_ctx) ((struct cfg_sim_state_x86 *)(sim_ctx)->state)
+
+#define $sim_get_reg(sim_ctx, mask, reg, val) \
+  cfg_sim$x86$inline_get_reg ($sim_x86_state (sim_ctx), (mask), (reg), (val))
+#define $sim_get_reg_width(sim_ctx, reg) \
+  cfg_sim$x86$inline_get_reg_width ((reg))
+#define $sim_set_reg(sim_ctx, reg, val) \
+  cfg_sim$x86$inline_set_reg ($sim_x86_state (sim_ctx), (reg), (val))
+#define $sim_set_pc(sim_ctx, val) \
+  cfg_sim$x86$inline_set_reg ($sim_x86_state (sim_ctx), X86_REG_RIP, (val))
+#define $sim_push_stack(sim_ctx, ptr, size) \
+  cfg_sim$x86$inline_push_stack ($sim_x86_state (sim_ctx), (ptr), (size))
+#define $sim_pop_stack(sim_ctx, dst, size) \
+  cfg_sim$x86$inline_pop_stack ($sim_x86_state (sim_ctx), (dst), (size))
+#define $sim_set_flag(sim_ctx, mask, val) \
+  cfg_sim$x86$inline_set_flag ($sim_x86_state (sim_ctx), (mask), (val))
+#define $sim_set_flags_lazy(sim_ctx, cc) \
+  cfg_sim$x86$inline_set_flags_lazy ($sim_x86_state (sim_ctx), (cc))
+#else
+#define $sim_get_reg(sim_ctx, mask, reg, val) \
+  (sim_ctx)->fn.get_reg ((sim_ctx)->state, (mask), (reg), (val))
+#define $sim_get_reg_width(sim_ctx, reg) \
+  (sim_ctx)->fn.get_reg_width ((sim_ctx)->state, (reg))
+#define $sim_set_reg(sim_ctx, reg, val) \
+  (sim_ctx)->fn.set_reg ((sim_ctx)->state, (reg), (val))
+#define $sim_set_pc(sim_ctx, val) \
+  (sim_ctx)->fn.set_pc ((sim_ctx)->state, (val))
+#define $sim_push_stack(sim_ctx, ptr, size) \
+  (sim_ctx)->fn.push_stack ((sim_ctx)->state, (ptr), (size))
+#define $sim_pop_stack(sim_ctx, dst, size) \
+  (sim_ctx)->fn.pop_stack ((sim_ctx)->state, (dst), (size))
+#define $sim_set_flag(sim_ctx, mask, val) \
+  (sim_ctx)->fn.set_flag ((sim_ctx)->state, (mask), (val))
+#define $sim_set_flags_lazy(sim_ctx, cc) \
+  (sim_ctx)->fn.set_flags_lazy ((sim_ctx)->state, (cc))
+#endif
 
 /* nasty work :u */
-#define $get_regloc_chk(sim_ctx, reg, regloc, regmask) \
-  uint64_t regmask; \
-  auto regloc = (sim_ctx)->fn.get_reg ((sim_ctx)->state, &regmask, (reg)); \
-  if ((regloc) == NULL) \
+#define $get_reg_chk(sim_ctx, reg, regval, regmask) \
+  uint64_t regval, regmask; \
+  if (!$sim_get_reg ((sim_ctx), &regmask, (reg), &regval)) \
   { \
     $trace_err ( \
       "indeterminate register (%s)", \
@@ -21,7 +65,7 @@ typedef struct _cfg_sim_ctx *cfg_sim_ctx_t;
 
 bool
 sim_dispatch$resolve_memop (
-  cfg_sim_ctx_t, struct x86_op_mem* mem, uint64_t* out_sib);
+  cfg_sim_ctx_t, const struct cfg_ir_mem* mem, uint64_t* out_sib);
 
 /* flag setting helpers */
 bool
@@ -37,15 +81,15 @@ bool sim_dispatch$update_flags__shift (
 bool sim_dispatch$update_flags__inc_dec (
   cfg_sim_ctx_t, enum x86_reg reg, uint64_t old_val, bool is_dec);
 
-/* instruction dispatch handlers */
-bool sim_dispatch$binop_reg_reg (cfg_sim_ctx_t, cs_insn* insn);
-bool sim_dispatch$binop_reg_imm (cfg_sim_ctx_t, cs_insn* insn);
-bool sim_dispatch$binop_reg_mem (cfg_sim_ctx_t, cs_insn* insn);
+/* instruction dispatch handlers, `idx` is the row of `ir` to simulate */
+bool sim_dispatch$binop_reg_reg (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
+bool sim_dispatch$binop_reg_imm (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
+bool sim_dispatch$binop_reg_mem (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
 
-bool sim_dispatch$binop_mem_reg (cfg_sim_ctx_t, cs_insn* insn);
-bool sim_dispatch$binop_mem_imm (cfg_sim_ctx_t, cs_insn* insn);
+bool sim_dispatch$binop_mem_reg (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
+bool sim_dispatch$binop_mem_imm (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
 
-bool sim_dispatch$unop_reg (cfg_sim_ctx_t, cs_insn* insn);
-bool sim_dispatch$unop_mem (cfg_sim_ctx_t, cs_insn* insn);
+bool sim_dispatch$unop_reg (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
+bool sim_dispatch$unop_mem (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
 
-bool sim_dispatch$nullop (cfg_sim_ctx_t, cs_insn* insn);
\ No newline at end of file
+bool sim_dispatch$nullop (cfg_sim_ctx_t, cfg_ir_t ir, size_t idx);
\ No newline at end of file
@@ -11,12 +11,13 @@ void graph$free (graph_t);
 
 __attribute__ (( malloc(graph$free, 1) ))
 graph_t graph$new (void);
+__attribute__ (( malloc(graph$free, 1) ))
+graph_t graph$new_in (arena_t);
 
 vertex_tag_t graph$add (graph_t, void* metadata);
 vertex_tag_t graph$add_tagged (graph_t, vertex_tag_t tag, void* metadata);
 void digraph$connect (graph_t, vertex_tag_t, vertex_tag_t);
 array_t digraph$get_egress (graph_t, vertex_tag_t);
-__attribute__(( malloc(array$free, 1) ))
 array_t digraph$get_ingress (graph_t, vertex_tag_t);
 __attribute__(( malloc(array$free, 1) ))
 array_t graph$get_edges (graph_t, vertex_tag_t);
@@ -24,4 +25,10 @@ void graph$connect (graph_t, vertex_tag_t, vertex_tag_t);
 void graph$disconnect (graph_t, vertex_tag_t, vertex_tag_t);
 void digraph$disconnect (graph_t, vertex_tag_t, vertex_tag_t);
 void* graph$metadata (graph_t, vertex_tag_t);
+bool graph$contains (graph_t, vertex_tag_t);
+/* vertices are stored densely, so a vertex's slot is in [0, vertex count) and
+ * can index per-vertex side tables
+ */
+size_t graph$get_slot (graph_t, vertex_tag_t);
+size_t graph$get_vertex_count (graph_t);
 bool graph$for_each_vertex (graph_t, iter_vertex_t callback, void* param);
\ No newline at end of file
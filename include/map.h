@@ -1,5 +1,6 @@
 #pragma once
 
+#include "arena.h"
 #include "generic.h"
 
 typedef struct _map *map_t;
@@ -11,12 +12,15 @@ void map$free (map_t);
 
 __attribute__ (( malloc(map$free, 1) ))
 map_t map$new (void);
+__attribute__ (( malloc(map$free, 1) ))
+map_t map$new_in (arena_t);
 
 void map$set (map_t, hashnum_t key, void* value);
 void* map$get (map_t, hashnum_t key);
 void map$remove (map_t, hashnum_t key);
 bool map$contains (map_t, hashnum_t key);
 bool map$is_empty (map_t);
+size_t map$length (map_t);
 hashnum_t map$compute_hash_sized (void* buff, size_t size);
 hashnum_t map$compute_hash (uint64_t octet);
 void map$for_each_pair (map_t, iter_foreach_t callback, void* data);
\ No newline at end of file
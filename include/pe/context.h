@@ -6,15 +6,28 @@
 #include "array.h"
 #include "pe/format.h"
 
-#define PE_CONTEXT_LOAD_IMPORT_DIRECTORY (1ull << 0)
-#define PE_CONTEXT_LOAD_EXPORT_DIRECTORY (1ull << 1)
-#define PE_CONTEXT_LOAD_TLS_DIRECTORY    (1ull << 2)
+#define PE_CONTEXT_LOAD_IMPORT_DIRECTORY    (1ull << 0)
+#define PE_CONTEXT_LOAD_EXPORT_DIRECTORY    (1ull << 1)
+#define PE_CONTEXT_LOAD_TLS_DIRECTORY       (1ull << 2)
+#define PE_CONTEXT_MAP_IMAGE                (1ull << 3)
+#define PE_CONTEXT_LOAD_EXCEPTION_DIRECTORY (1ull << 4)
 
 struct export_func_entry
 {
-  char* func_name;
+  /* NULL if exported by ordinal only, with aliases the first name in the
+   * name pointer table. borrowed from `exports.by_name`
+   */
+  const char* func_name;
   uint16_t ordinal;  /* unbiased */
-  struct image_export_table_entry rva;
+  union image_export_table_entry rva;
+  bool is_forwarded;
+};
+
+/* one per exported name, so aliases of a function have one each */
+struct export_name_entry
+{
+  char* name;
+  struct export_func_entry* function;
 };
 
 struct import_func_entry
@@ -36,13 +49,23 @@ struct import_entry
 typedef struct
 {
   FILE* stream;
+  struct
+  {
+    /* NULL unless the image is memory-mapped, see `PE_CONTEXT_MAP_IMAGE` */
+    const uint8_t* base;
+    size_t size;
+  } image;
   struct image_dos_header dos_header;
   struct image_nt_headers nt_header;
   array_t /* struct image_section_header */ section_headers;
+  array_t /* struct image_section_header*, by RVA */ sorted_sections;
   struct
   {
     struct image_export_directory descriptor;
     array_t /* struct export_func_entry */ functions;
+    /* see `pe$find_export_by_{name,rva}` */
+    array_t /* struct export_name_entry */ by_name;
+    array_t /* struct export_func_entry* */ by_rva;
   } exports;
   array_t /* struct import_entry */ imports;
   struct
@@ -50,6 +73,8 @@ typedef struct
     struct image_tls_table descriptor;
     array_t callbacks;
   } tls;
+  /* sorted by `begin_address`, see `pe$find_runtime_function` */
+  array_t /* struct image_runtime_function_entry */ runtime_functions;
 } *pe_context_t;
 
 void pe$free (pe_context_t);
@@ -57,9 +82,37 @@ void pe$free (pe_context_t);
 __attribute__ (( malloc(pe$free, 1)))
 pe_context_t pe$from_file (FILE* file, uint8_t flags);
 
-bool pe$read_import_descriptors (pe_context_t, uint32_t offset);
-bool pe$read_export_descriptors (pe_context_t, uint32_t offset);
-bool pe$read_tls_directory (pe_context_t, uint32_t offset);
+bool pe$read_import_descriptors (pe_context_t, uint32_t rva);
+/* the export, TLS and exception directories are optional, a zero `rva`
+ * leaves their tables empty
+ */
+bool pe$read_export_descriptors (pe_context_t, uint32_t rva);
+/* NULL if nothing is exported under that name, every alias of a function
+ * finds it
+ */
+const struct export_func_entry* pe$find_export_by_name (
+  pe_context_t, const char* name);
+/* NULL unless an export begins exactly at `rva` */
+const struct export_func_entry* pe$find_export_by_rva (
+  pe_context_t, uint64_t rva);
+bool pe$read_tls_directory (pe_context_t, uint32_t rva);
+bool pe$read_exception_directory (pe_context_t, uint32_t rva, uint32_t size);
+/* the runtime function whose range contains `rva`, NULL if it's a leaf
+ * function or not code at all
+ */
+const struct image_runtime_function_entry* pe$find_runtime_function (
+  pe_context_t, uint64_t rva);
+/* chained entries describe a fragment of the function of the entry they
+ * chain to, rather than a function of their own
+ */
+bool pe$is_runtime_function_chained (
+  pe_context_t, const struct image_runtime_function_entry* function);
+/* the fixed stack allocation made by the prologue, excluding pushes, false
+ * if the unwind info can't be read
+ */
+bool pe$get_unwind_alloc_size (
+  pe_context_t, const struct image_runtime_function_entry* function,
+  uint64_t* size);
 uint64_t pe$find_fileoffs_by_rva (
   pe_context_t, struct image_section_header** out, uint64_t rva);
 bool pe$is_image_x64 (pe_context_t);
@@ -71,8 +124,16 @@ int pe$read_maxint (uint64_t* into, pe_context_t);
 uint64_t pe$find_directory_fileoffs (pe_context_t, uint8_t index);
 struct image_section_header* pe$find_section_by_rva (
   pe_context_t, uint64_t rva);
+uint32_t pe$get_section_virtual_size (struct image_section_header*);
 uint32_t pe$get_pagesize (pe_context_t);
 size_t pe$get_ptrsize (pe_context_t);
 __attribute__ (( malloc(free, 1) ))
 uint8_t* pe$read_sized (pe_context_t, uint64_t rva, uint64_t size);
-uint8_t* pe$read_page_at (pe_context_t, uint64_t rva);
\ No newline at end of file
+uint8_t* pe$read_page_at (pe_context_t, uint64_t rva);
+bool pe$is_image_mapped (pe_context_t);
+const uint8_t* pe$view_rva (pe_context_t, uint64_t rva, uint64_t* len);
+const uint8_t* pe$view_sized (pe_context_t, uint64_t rva, uint64_t size);
+bool pe$read_rva (pe_context_t, void* into, uint64_t rva, uint64_t size);
+int pe$read_maxint_rva (pe_context_t, uint64_t* into, uint64_t rva);
+int pe$read_asciz_rva (
+  pe_context_t, char* into, ssize_t max_length, uint64_t rva);
\ No newline at end of file
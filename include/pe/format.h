@@ -28,6 +28,23 @@
 #define IMAGE_SCN_MEM_READ    (0x40000000)
 #define IMAGE_SCN_MEM_WRITE   (0x80000000)
 
+#define UNW_FLAG_NHANDLER  (0)
+#define UNW_FLAG_EHANDLER  (1)
+#define UNW_FLAG_UHANDLER  (2)
+#define UNW_FLAG_CHAININFO (4)
+
+#define UWOP_PUSH_NONVOL     (0)
+#define UWOP_ALLOC_LARGE     (1)
+#define UWOP_ALLOC_SMALL     (2)
+#define UWOP_SET_FPREG       (3)
+#define UWOP_SAVE_NONVOL     (4)
+#define UWOP_SAVE_NONVOL_FAR (5)
+#define UWOP_EPILOG          (6)
+#define UWOP_SPARE_CODE      (7)
+#define UWOP_SAVE_XMM128     (8)
+#define UWOP_SAVE_XMM128_FAR (9)
+#define UWOP_PUSH_MACHFRAME  (10)
+
 #define MAX_PATH            (260)
 #define MAX_FUNCNAME_LENGTH (256)
 
@@ -161,7 +178,8 @@ struct image_export_directory
   uint32_t address_of_name_ordinals;
 };
 
-struct image_export_table_entry
+/* forwarder RVAs point at a string within the export directory itself */
+union image_export_table_entry
 {
   uint32_t address;
   uint32_t forwarder;
@@ -196,4 +214,32 @@ struct image_tls_table
   uint32_t characteristics;
 };
 
+struct image_runtime_function_entry
+{
+  uint32_t begin_address;
+  uint32_t end_address;
+  uint32_t unwind_info_address;
+};
+
+struct image_unwind_info
+{
+  uint8_t version : 3;
+  uint8_t flags : 5;
+  uint8_t size_of_prolog;
+  uint8_t count_of_codes;
+  uint8_t frame_register : 4;
+  uint8_t frame_offset : 4;
+};
+
+union image_unwind_code
+{
+  struct
+  {
+    uint8_t code_offset;
+    uint8_t unwind_op : 4;
+    uint8_t op_info : 4;
+  };
+  uint16_t frame_offset;
+};
+
 #pragma pack(pop)
\ No newline at end of file
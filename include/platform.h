@@ -1,6 +1,11 @@
 #pragma once
 
+#include <stdio.h>
+#include <stddef.h>
+
 void* platform_load_library (const char* name);
 void platform_free_library (void* module);
 void* platform_get_procedure (void* module, const char* procname);
-void* platform_readgs (void);
\ No newline at end of file
+void* platform_readgs (void);
+void* platform_map_file (FILE* file, size_t* size);
+void platform_unmap_file (void* base, size_t size);
\ No newline at end of file
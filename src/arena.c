@@ -0,0 +1,129 @@
+#include <stdalign.h>
+#include <string.h>
+
+#include "arena.h"
+#include "generic.h"
+
+#define ARENA_ALIGNMENT  (16ull)
+#define ARENA_CHUNK_SIZE (64ull * 1024)
+
+struct arena_chunk
+{
+  struct arena_chunk* next;
+  size_t size, used;
+  alignas (ARENA_ALIGNMENT) uint8_t data[];
+};
+
+struct _arena
+{
+  struct arena_chunk* head;
+  /* last allocation from `head`, the only one that can grow in place */
+  uint8_t* last_alloc;
+  size_t total_size;
+};
+
+static struct arena_chunk*
+new_chunk (arena_t arena, size_t size)
+{
+  /* NB: chunks are zeroed once, and memory is never handed out twice */
+  struct arena_chunk* chunk = $chk_calloc (1, sizeof (*chunk) + size);
+  chunk->size = size;
+  arena->total_size += size;
+  $trace_debug ("allocated arena (%p) chunk of %zu bytes", arena, size);
+  return chunk;
+}
+
+arena_t
+arena$new (void)
+{
+  auto arena = $chk_allocty (arena_t);
+  $trace_debug ("creating new arena (@%p)", arena);
+  return arena;
+}
+
+void
+arena$free (arena_t arena)
+{
+  $trace_debug (
+    "freeing arena (%p) holding %zu bytes", arena, arena->total_size);
+  for (auto chunk = arena->head; chunk != NULL;)
+  {
+    auto next = chunk->next;
+    $chk_free (chunk);
+    chunk = next;
+  }
+  $chk_free (arena);
+}
+
+void*
+arena$alloc (arena_t arena, size_t size)
+{
+  if (arena == NULL)
+    return $chk_allocb (size);
+
+  size = $round_up_to (ARENA_ALIGNMENT, $max (size, (size_t)1));
+  auto chunk = arena->head;
+  if (chunk == NULL || (chunk->size - chunk->used) < size)
+  {
+    if (size > ARENA_CHUNK_SIZE / 4 && chunk != NULL)
+    {
+      /* large allocations get a chunk of their own behind the current one,
+       * so the space left in it isn't thrown away
+       */
+      auto large = new_chunk (arena, size);
+      large->used = size;
+      large->next = chunk->next;
+      chunk->next = large;
+      return large->data;
+    }
+    chunk = new_chunk (arena, $max (size, ARENA_CHUNK_SIZE));
+    chunk->next = arena->head;
+    arena->head = chunk;
+  }
+  arena->last_alloc = &chunk->data[chunk->used];
+  chunk->used += size;
+  return arena->last_alloc;
+}
+
+void*
+arena$realloc (arena_t arena, void* ptr, size_t old_size, size_t new_size)
+{
+  if (arena == NULL)
+    return $chk_realloc (ptr, new_size);
+
+  auto chunk = arena->head;
+  if (ptr != NULL && ptr == arena->last_alloc)
+  {
+    size_t offset = arena->last_alloc - chunk->data;
+    auto rounded_size
+      = $round_up_to (ARENA_ALIGNMENT, $max (new_size, (size_t)1));
+    if (offset + rounded_size <= chunk->size)
+    {
+      /* clear anything given back, it may be handed out again */
+      if (offset + rounded_size < chunk->used)
+        memset (
+          &chunk->data[offset + rounded_size], 0,
+          chunk->used - offset - rounded_size);
+      chunk->used = offset + rounded_size;
+      return ptr;
+    }
+  }
+
+  auto new = arena$alloc (arena, new_size);
+  if (ptr != NULL)
+    memcpy (new, ptr, $min (old_size, new_size));
+  return new;
+}
+
+void
+arena$dealloc (arena_t arena, void* ptr)
+{
+  if (arena == NULL)
+    $chk_free (ptr);
+}
+
+size_t
+arena$get_size (arena_t arena)
+{
+  return arena->total_size;
+}
\ No newline at end of file
@@ -1,6 +1,8 @@
+#include <stdalign.h>
 #include <stdbool.h>
 #include <string.h>
 
+#include "arena.h"
 #include "array.h"
 #include "trace.h"
 
@@ -8,6 +10,7 @@
 #define INITIAL_BYTE_CAPACITY (64ull)
 
 static const struct array_allocopts g_default_allocopts = {
+  .growth                 = ARRAY_GROWTH_GEOMETRIC,
   .alloc_nmemb_increment  = 4,
   .trim_nmemb_threshold   = 8,
   .min_nmemb              = 0,
@@ -19,11 +22,14 @@ static const struct array_allocopts g_default_allocopts = {
 
 struct _array
 {
+  arena_t arena;
   uint8_t* raw;
   size_t capacity;
   size_t nmemb;
   size_t membsize, membsize_unaligned;
   struct array_allocopts allocopts;
+  size_t inline_capacity;
+  alignas (MEMBER_ALIGNMENT) uint8_t inline_raw[];
 };
 
 static bool
@@ -62,6 +68,54 @@ get_array_head (array_t array)
   return get_array_at_unchecked (array, array->nmemb);
 }
 
+static bool
+is_inline (array_t array)
+{
+  return array->inline_capacity && array->raw == array->inline_raw;
+}
+
+/* NB: members are moved bytewise like `realloc` would, copy hooks are only
+ *     for members entering or moving within the array
+ */
+static void
+resize_array (array_t array, size_t new_capacity)
+{
+  if (new_capacity <= array->inline_capacity)
+  {
+    if (!is_inline (array))
+    {
+      memcpy (array->inline_raw, array->raw, array->nmemb * array->membsize);
+      arena$dealloc (array->arena, array->raw);
+      array->raw = array->inline_raw;
+    }
+    array->capacity = array->inline_capacity;
+    return;
+  }
+
+  if (is_inline (array))
+  {
+    auto raw = arena$alloc (array->arena, new_capacity);
+    memcpy (raw, array->inline_raw, array->nmemb * array->membsize);
+    array->raw = raw;
+  }
+  else
+    array->raw = arena$realloc (
+      array->arena, array->raw, array->capacity, new_capacity);
+  array->capacity = new_capacity;
+}
+
+/* NB: an inline array can always fall back on its inline buffer, so it may
+ *     shrink down to it rather than to the initial heap capacity
+ */
+static size_t
+get_min_capacity (array_t array)
+{
+  auto floor = array->inline_capacity
+    ? array->inline_capacity
+    : $max (array->membsize, INITIAL_BYTE_CAPACITY);
+  return $max (floor, array->allocopts.min_nmemb * array->membsize);
+}
+
 static void*
 maybe_extend_array (array_t array)
 {
@@ -73,19 +127,16 @@ maybe_extend_array (array_t array)
       $abort ("tried to insert data into fixed-size array");
     if (is_tuple (array))
       $abort ("tried to insert data into full tuple");
-    size_t new_capacity;
+    auto new_nmemb = array->nmemb + allocopts.alloc_nmemb_increment;
+    if (allocopts.growth == ARRAY_GROWTH_GEOMETRIC)
+      new_nmemb = $max (new_nmemb, 2 * array->nmemb);
     if (allocopts.max_nmemb)
-      new_capacity = array->membsize * $min (
-        array->nmemb + allocopts.alloc_nmemb_increment,
-        allocopts.max_nmemb);
-    else
-      new_capacity
-        = array->membsize * (array->nmemb + allocopts.alloc_nmemb_increment);
+      new_nmemb = $min (new_nmemb, allocopts.max_nmemb);
+    auto new_capacity = array->membsize * new_nmemb;
     $trace_debug (
       "extending array capacity from %zu bytes to %zu",
       array->capacity, new_capacity);
-    array->capacity = new_capacity;
-    array->raw = $chk_realloc (array->raw, array->capacity);
+    resize_array (array, new_capacity);
   }
   return get_array_head (array);
 }
@@ -96,17 +147,45 @@ maybe_downsize_array (array_t array)
   auto allocopts = array->allocopts;
   if (!allocopts.trim_nmemb_threshold || is_tuple (array))
     return;
+
+  /* a spilled inline array moves back once it's down to half its inline
+   * buffer, however few members that frees, which leaves room for appends
+   * before it spills again
+   */
+  if (array->inline_capacity && !is_inline (array)
+      && (2 * array->nmemb * array->membsize <= array->inline_capacity))
+  {
+    $trace_debug (
+      "moving array of %zu bytes back inline", array->nmemb * array->membsize);
+    resize_array (array, array->inline_capacity);
+    return;
+  }
+
   auto free_nmemb = get_free_capacity (array) / array->membsize;
   size_t nmemb_threshold = allocopts.trim_nmemb_threshold;
-  if (free_nmemb >= nmemb_threshold)
+  if (free_nmemb < nmemb_threshold)
+    return;
+
+  size_t new_capacity;
+  if (allocopts.growth == ARRAY_GROWTH_GEOMETRIC)
   {
-    auto new_capacity = array->capacity - nmemb_threshold * array->membsize;
-    $trace_debug (
-      "downsizing array from %zu bytes to %zu",
-      array->capacity, new_capacity);
-    array->raw = $chk_realloc (array->raw, new_capacity);
-    array->capacity = new_capacity;
+    /* shrinking to half only once a quarter is used leaves room for as many
+     * appends as were removed, so alternating append/remove can't thrash
+     */
+    if (4 * array->nmemb * array->membsize > array->capacity)
+      return;
+    new_capacity = array->capacity / 2;
   }
+  else
+    new_capacity = array->capacity - nmemb_threshold * array->membsize;
+
+  new_capacity = $max (new_capacity, get_min_capacity (array));
+  if (new_capacity >= array->capacity)
+    return;
+  $trace_debug (
+    "downsizing array from %zu bytes to %zu",
+    array->capacity, new_capacity);
+  resize_array (array, new_capacity);
 }
 
 static void
@@ -126,15 +205,50 @@ check_index_bounds (array_t array, size_t idx)
 array_t
 array$new (size_t membsize)
 {
-  auto array = $chk_allocty (array_t);
+  return array$new_in (NULL, membsize);
+}
+
+array_t
+array$new_in (arena_t arena, size_t membsize)
+{
+  array_t array = arena$alloc (arena, sizeof (*array));
   $trace_debug (
     "creating new array with member size: %zu byte(s) (@%p)",
     membsize, array);
+  array->arena = arena;
   array->allocopts = g_default_allocopts;
   array->membsize = $round_up_to (MEMBER_ALIGNMENT, membsize);
   array->membsize_unaligned = membsize;
   array->capacity = $max (array->membsize, INITIAL_BYTE_CAPACITY);
-  array->raw = $chk_allocb (array->capacity);
+  array->raw = arena$alloc (arena, array->capacity);
+  return array;
+}
+
+array_t
+array$new_inline (size_t membsize, size_t inline_nmemb)
+{
+  return array$new_inline_in (NULL, membsize, inline_nmemb);
+}
+
+array_t
+array$new_inline_in (arena_t arena, size_t membsize, size_t inline_nmemb)
+{
+  if (!inline_nmemb)
+    return array$new_in (arena, membsize);
+  auto aligned_membsize = $round_up_to (MEMBER_ALIGNMENT, membsize);
+  auto inline_capacity = aligned_membsize * inline_nmemb;
+  array_t array = arena$alloc (arena, sizeof (*array) + inline_capacity);
+  $trace_debug (
+    "creating new array with member size: %zu byte(s), "
+    "%zu inline member(s) (@%p)",
+    membsize, inline_nmemb, array);
+  array->arena = arena;
+  array->allocopts = g_default_allocopts;
+  array->membsize = aligned_membsize;
+  array->membsize_unaligned = membsize;
+  array->inline_capacity = inline_capacity;
+  array->capacity = inline_capacity;
+  array->raw = array->inline_raw;
   return array;
 }
 
@@ -152,9 +266,11 @@ void
 array$_default_free_hook (void* ptr)
 {
   array_t array = ptr;
-  if (array != NULL)
-    $chk_free (array->raw);
-  $chk_free (array);
+  if (array == NULL)
+    return;
+  if (!is_inline (array))
+    arena$dealloc (array->arena, array->raw);
+  arena$dealloc (array->arena, array);
 }
 
 void
@@ -220,7 +336,7 @@ array$remove (array_t array, size_t idx)
   array->allocopts.hook_memmove (
     get_array_at_unchecked(array, idx),
     get_array_at_unchecked(array, idx + 1),
-    array->membsize * (array->nmemb - idx + 1));
+    array->membsize * (array->nmemb - idx - 1));
 ret:
   array->nmemb--;
   maybe_downsize_array (array);
@@ -271,6 +387,13 @@ array$at (array_t array, size_t idx)
   return get_array_at_unchecked (array, idx);
 }
 
+void
+array$clear (array_t array)
+{
+  /* NB: keeps the capacity, for arrays reused as scratch space */
+  array->nmemb = 0;
+}
+
 void
 array$pop (array_t array, void* into, size_t idx)
 {
@@ -292,6 +415,12 @@ array$concat (array_t array, array_t other)
   }
 }
 
+void
+array$sort (array_t array, array_compare_fn_t compare)
+{
+  qsort (array->raw, array->nmemb, array->membsize, compare);
+}
+
 bool
 array$contains_rval (array_t array, uintmax_t memb)
 {
@@ -338,12 +467,14 @@ array$allocopts (array_t array, struct array_allocopts opts)
     $abort ("reallocation increment must be positive");
   if (opts.max_nmemb && (opts.trim_nmemb_threshold > opts.max_nmemb))
     $abort ("trim threshold is too large within the capacity constraints");
+  array->allocopts.growth = opts.growth;
   array->allocopts.alloc_nmemb_increment = opts.alloc_nmemb_increment;
+  array->allocopts.trim_nmemb_threshold = opts.trim_nmemb_threshold;
   $trace_debug (
-    "configuring allocation options for array (%p): "
+    "configuring allocation options for array (%p): growth policy=%d, "
     "min./max. memb=%zu/%zu, alloc. increment=%zu, trim threshold=%zu",
-    array, opts.min_nmemb, opts.max_nmemb, opts.alloc_nmemb_increment,
-    opts.trim_nmemb_threshold);
+    array, opts.growth, opts.min_nmemb, opts.max_nmemb,
+    opts.alloc_nmemb_increment, opts.trim_nmemb_threshold);
   auto min_capacity = opts.min_nmemb * array->membsize;
   array->nmemb = opts.min_nmemb;
   if (array->capacity < min_capacity)
@@ -352,8 +483,7 @@ array$allocopts (array_t array, struct array_allocopts opts)
       "growing array (%p) to meet min. capacity constraint "
       "(from %zu to %zu bytes)",
       array, array->capacity, min_capacity);
-    array->raw = $chk_realloc (array->raw, min_capacity);
-    array->capacity = min_capacity;
+    resize_array (array, min_capacity);
   }
 }
 
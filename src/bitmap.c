@@ -1,37 +1,309 @@
 #include "bitmap.h"
 #include "generic.h"
 
-#define $bits_up_to(bit) ((2u << (bit)) - 1)
-#define $bits_from(bit) (~((1u << (bit)) - 1))
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+/* the bitmap is split into pages of `BITMAP_PAGE_BITS` bits, each page is
+ * only allocated once a bit inside it is set, so the memory used scales with
+ * the addresses actually visited rather than with the range
+ */
+#define BITMAP_PAGE_BITS 4096
+#define BITMAP_WORD_BITS (8 * sizeof (uint64_t))
+#define BITMAP_PAGE_WORDS (BITMAP_PAGE_BITS / BITMAP_WORD_BITS)
+
+#define $bits_up_to(bit) ((2ull << (bit)) - 1)
+#define $bits_from(bit) (~((1ull << (bit)) - 1))
 #define $bits_range(start, end) ($bits_up_to (end) & $bits_from (start))
 
+/* word spans shorter than this aren't worth an indirect call */
+#define BITMAP_SIMD_MIN_WORDS 8
+
+struct bitmap_kernels
+{
+  size_t (*find_word_not_equal) (
+    const uint64_t* words, size_t count, uint64_t pattern);
+  size_t (*popcount_words) (const uint64_t* words, size_t count);
+};
+
+static size_t
+find_word_not_equal_scalar (
+  const uint64_t* words, size_t count, uint64_t pattern)
+{
+  size_t i = 0;
+  for (; i < count && words[i] == pattern; ++i);
+  return i;
+}
+
+static size_t
+popcount_words_scalar (const uint64_t* words, size_t count)
+{
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i)
+    total += __builtin_popcountg (words[i]);
+  return total;
+}
+
+static const struct bitmap_kernels g_scalar_kernels = {
+  .find_word_not_equal = find_word_not_equal_scalar,
+  .popcount_words = popcount_words_scalar,
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+/* NB: the vector loops only narrow down the chunk holding the mismatch, the
+ *     exact word and any tail are resolved by the scalar loop afterwards
+ */
+__attribute__ (( target ("sse2") )) static size_t
+find_word_not_equal_sse2 (
+  const uint64_t* words, size_t count, uint64_t pattern)
+{
+  /* no 64-bit compare in SSE2, comparing halves is equivalent for equality */
+  auto vpattern = _mm_set1_epi64x ((long long)pattern);
+  size_t i = 0;
+  for (; i + 2 <= count; i += 2)
+  {
+    auto v = _mm_loadu_si128 ((const __m128i *)&words[i]);
+    if (_mm_movemask_epi8 (_mm_cmpeq_epi32 (v, vpattern)) != 0xffff)
+      break;
+  }
+  for (; i < count && words[i] == pattern; ++i);
+  return i;
+}
+
+__attribute__ (( target ("avx2") )) static size_t
+find_word_not_equal_avx2 (
+  const uint64_t* words, size_t count, uint64_t pattern)
+{
+  auto vpattern = _mm256_set1_epi64x ((long long)pattern);
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    auto v = _mm256_loadu_si256 ((const __m256i *)&words[i]);
+    if (_mm256_movemask_epi8 (_mm256_cmpeq_epi64 (v, vpattern)) != -1)
+      break;
+  }
+  for (; i < count && words[i] == pattern; ++i);
+  return i;
+}
+
+__attribute__ (( target ("popcnt") )) static size_t
+popcount_words_popcnt (const uint64_t* words, size_t count)
+{
+  size_t total = 0;
+  for (size_t i = 0; i < count; ++i)
+    total += __builtin_popcountll (words[i]);
+  return total;
+}
+
+/* nibble lookup table popcount, summed per 64-bit lane with `vpsadbw` */
+__attribute__ (( target ("avx2,popcnt") )) static size_t
+popcount_words_avx2 (const uint64_t* words, size_t count)
+{
+  auto lut = _mm256_setr_epi8 (
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+    0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  auto low_nibbles = _mm256_set1_epi8 (0x0f);
+  auto acc = _mm256_setzero_si256 ();
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4)
+  {
+    auto v = _mm256_loadu_si256 ((const __m256i *)&words[i]);
+    auto lo = _mm256_and_si256 (v, low_nibbles);
+    auto hi = _mm256_and_si256 (_mm256_srli_epi16 (v, 4), low_nibbles);
+    auto bytes = _mm256_add_epi8 (
+      _mm256_shuffle_epi8 (lut, lo), _mm256_shuffle_epi8 (lut, hi));
+    acc = _mm256_add_epi64 (
+      acc, _mm256_sad_epu8 (bytes, _mm256_setzero_si256 ()));
+  }
+  /* NB: `_mm256_extract_epi64` is x86-64 only, the lanes are stored out
+   *     instead so this also builds for i386
+   */
+  uint64_t lanes[4];
+  _mm256_storeu_si256 ((__m256i *)lanes, acc);
+  size_t total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  for (; i < count; ++i)
+    total += __builtin_popcountll (words[i]);
+  return total;
+}
+
+static const struct bitmap_kernels g_sse2_kernels = {
+  .find_word_not_equal = find_word_not_equal_sse2,
+  .popcount_words = popcount_words_scalar,
+};
+
+static const struct bitmap_kernels g_sse2_popcnt_kernels = {
+  .find_word_not_equal = find_word_not_equal_sse2,
+  .popcount_words = popcount_words_popcnt,
+};
+
+static const struct bitmap_kernels g_avx2_kernels = {
+  .find_word_not_equal = find_word_not_equal_avx2,
+  .popcount_words = popcount_words_avx2,
+};
+#endif
+
+static const struct bitmap_kernels* g_bitmap_kernels = &g_scalar_kernels;
+
+static void
+select_bitmap_kernels (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2") && __builtin_cpu_supports ("popcnt"))
+    g_bitmap_kernels = &g_avx2_kernels;
+  else if (__builtin_cpu_supports ("sse2"))
+    g_bitmap_kernels = __builtin_cpu_supports ("popcnt")
+      ? &g_sse2_popcnt_kernels : &g_sse2_kernels;
+#endif
+}
+
 struct _bitmap
 {
-  uint8_t* array;
+  uint64_t** pages;
+  size_t page_count;
   size_t size;
 };
 
 struct bitmap_index
 {
+  size_t page;
   size_t idx;
   size_t offset;
 };
 
 static struct bitmap_index
-get_bitmap_index (bitmap_t bitmap, size_t idx)
+get_bitmap_index (size_t idx)
 {
   return (struct bitmap_index){
-    .idx = idx / (8 * sizeof (*bitmap->array)),
-    .offset = idx % (8 * sizeof (*bitmap->array))
+    .page = idx / BITMAP_PAGE_BITS,
+    .idx = (idx % BITMAP_PAGE_BITS) / BITMAP_WORD_BITS,
+    .offset = idx % BITMAP_WORD_BITS
   };
 }
 
+static uint64_t*
+get_or_new_page (bitmap_t bitmap, size_t page)
+{
+  if (bitmap->pages[page] == NULL)
+  {
+    $trace_debug ("allocating bitmap page %zu", page);
+    bitmap->pages[page] = $chk_calloc (sizeof (uint64_t), BITMAP_PAGE_WORDS);
+  }
+  return bitmap->pages[page];
+}
+
+/* `start` and `end` are inclusive bit offsets into the same page */
+static void
+set_page_range (uint64_t* words, size_t start, size_t end)
+{
+  auto start_index = get_bitmap_index (start);
+  auto end_index = get_bitmap_index (end);
+
+  if (start_index.idx == end_index.idx)
+  {
+    words[start_index.idx] 
+      |= $bits_range (start_index.offset, end_index.offset);
+    return;
+  }
+
+  words[start_index.idx] |= $bits_from (start_index.offset);
+  memset (
+    &words[start_index.idx + 1], 0xff,
+    (end_index.idx - start_index.idx - 1) * sizeof (*words));
+  words[end_index.idx] |= $bits_up_to (end_index.offset);
+}
+
+static size_t
+find_word_not_equal (const uint64_t* words, size_t count, uint64_t pattern)
+{
+  if (count >= BITMAP_SIMD_MIN_WORDS)
+    return g_bitmap_kernels->find_word_not_equal (words, count, pattern);
+  return find_word_not_equal_scalar (words, count, pattern);
+}
+
+static size_t
+popcount_words (const uint64_t* words, size_t count)
+{
+  if (count >= BITMAP_SIMD_MIN_WORDS)
+    return g_bitmap_kernels->popcount_words (words, count);
+  return popcount_words_scalar (words, count);
+}
+
+/* offset of the first bit in [start, end] that differs from the matching bit
+ * in `skip`, i.e. the first set bit for `skip = 0` and the first clear bit for
+ * `skip = UINT64_MAX`, or `BITMAP_PAGE_BITS` if there is none
+ */
+static size_t
+find_in_page_range (
+  const uint64_t* words, size_t start, size_t end, uint64_t skip)
+{
+  auto start_index = get_bitmap_index (start);
+  auto end_index = get_bitmap_index (end);
+
+  auto first = (words[start_index.idx] ^ skip) & $bits_from (start_index.offset);
+  if (start_index.idx == end_index.idx)
+    first &= $bits_up_to (end_index.offset);
+  if (first)
+    return start_index.idx * BITMAP_WORD_BITS + __builtin_ctzll (first);
+  if (start_index.idx == end_index.idx)
+    return BITMAP_PAGE_BITS;
+
+  auto middle = start_index.idx + 1;
+  auto count = end_index.idx - middle;
+  auto found = find_word_not_equal (&words[middle], count, skip);
+  if (found < count)
+    return (middle + found) * BITMAP_WORD_BITS
+      + __builtin_ctzll (words[middle + found] ^ skip);
+
+  auto last = (words[end_index.idx] ^ skip) & $bits_up_to (end_index.offset);
+  if (last)
+    return end_index.idx * BITMAP_WORD_BITS + __builtin_ctzll (last);
+  return BITMAP_PAGE_BITS;
+}
+
+static size_t
+popcount_page_range (const uint64_t* words, size_t start, size_t end)
+{
+  auto start_index = get_bitmap_index (start);
+  auto end_index = get_bitmap_index (end);
+
+  if (start_index.idx == end_index.idx)
+    return __builtin_popcountg (
+      words[start_index.idx]
+      & $bits_range (start_index.offset, end_index.offset));
+
+  return __builtin_popcountg (
+           words[start_index.idx] & $bits_from (start_index.offset))
+    + popcount_words (
+           &words[start_index.idx + 1], end_index.idx - start_index.idx - 1)
+    + __builtin_popcountg (
+           words[end_index.idx] & $bits_up_to (end_index.offset));
+}
+
+/* splits [start, end) on page boundaries, `page_start`/`page_end` are the
+ * inclusive bit offsets of the current slice within `page`
+ */
+#define $for_each_page_in_range(start, end, page, page_start, page_end)       \
+  for (size_t page = (start) / BITMAP_PAGE_BITS,                              \
+              page##_last = ((end) - 1) / BITMAP_PAGE_BITS,                   \
+              page_start = (start) % BITMAP_PAGE_BITS,                        \
+              page_end = page == page##_last ? ((end) - 1) % BITMAP_PAGE_BITS \
+                                             : BITMAP_PAGE_BITS - 1;          \
+       page <= page##_last;                                                   \
+       ++page, page_start = 0,                                                \
+              page_end = page == page##_last ? ((end) - 1) % BITMAP_PAGE_BITS \
+                                             : BITMAP_PAGE_BITS - 1)
+
 bitmap_t
 bitmap$new (size_t range)
 {
+  if (g_bitmap_kernels == &g_scalar_kernels)
+    select_bitmap_kernels ();
   auto bitmap = $chk_allocty (bitmap_t);
-  bitmap->array = $chk_calloc (
-    sizeof (*bitmap->array), $round_up_to (8, range) / 8);
+  bitmap->page_count = $round_up_to (BITMAP_PAGE_BITS, range) / BITMAP_PAGE_BITS;
+  bitmap->pages = $chk_calloc (sizeof (*bitmap->pages), bitmap->page_count);
   bitmap->size = range;
   $trace_debug ("allocated bitmap with range %zu", range);
   return bitmap;
@@ -41,7 +313,9 @@ void
 bitmap$free (bitmap_t bitmap)
 {
   $trace_debug ("freeing bitmap at %p", bitmap);
-  $chk_free (bitmap->array);
+  for (size_t i = 0; i < bitmap->page_count; ++i)
+    $chk_free (bitmap->pages[i]);
+  $chk_free (bitmap->pages);
   $chk_free (bitmap);
 }
 
@@ -50,8 +324,8 @@ bitmap$set (bitmap_t bitmap, size_t idx)
 {
   $trace_debug ("trying to set bitmap index %zu (bitmap size %zu)", idx, bitmap->size);
   $strict_assert (idx < bitmap->size, "Bitmap index out of bounds");
-  auto index = get_bitmap_index (bitmap, idx);
-  bitmap->array[index.idx] |= 1u << index.offset;
+  auto index = get_bitmap_index (idx);
+  get_or_new_page (bitmap, index.page)[index.idx] |= 1ull << index.offset;
 }
 
 void
@@ -61,82 +335,80 @@ bitmap$set_range (bitmap_t bitmap, size_t start, size_t end)
     start < end && end <= bitmap->size,
     "Invalid or out of bounds bitmap indices");
   $trace_debug ("setting bit-range from %zu to %zu exclusive", start, end);
-  auto start_index = get_bitmap_index (bitmap, start);
-  auto end_index = get_bitmap_index (bitmap, end - 1);
-
-  if (start_index.idx == end_index.idx)
-  {
-    bitmap->array[start_index.idx] 
-      |= $bits_range (start_index.offset, end_index.offset);
-    return;
-  }
-
-  bitmap->array[start_index.idx] |= $bits_from (start_index.offset);
-  for (size_t i = start_index.idx + 1; i < end_index.idx; ++i)
-    bitmap->array[i] = (typeof (*bitmap->array))(-1);
-  bitmap->array[end_index.idx] |= $bits_up_to (end_index.offset);
+  $for_each_page_in_range (start, end, page, page_start, page_end)
+    set_page_range (get_or_new_page (bitmap, page), page_start, page_end);
 }
 
 bool
 bitmap$test (bitmap_t bitmap, size_t idx)
 {
   $strict_assert (idx < bitmap->size, "Bitmap index out of bounds");
-  auto index = get_bitmap_index (bitmap, idx);
-  return bitmap->array[index.idx] & (1u << index.offset);
+  auto index = get_bitmap_index (idx);
+  auto words = bitmap->pages[index.page];
+  return words && (words[index.idx] & (1ull << index.offset));
 }
 
-bool
-bitmap$test_any_in_range (bitmap_t bitmap, size_t start, size_t end)
+static size_t
+find_first_in_range (bitmap_t bitmap, size_t start, size_t end, uint64_t skip)
+{
+  $for_each_page_in_range (start, end, page, page_start, page_end)
+  {
+    auto words = bitmap->pages[page];
+    /* unallocated pages are entirely clear */
+    if (words == NULL)
+    {
+      if (skip)
+        return page * BITMAP_PAGE_BITS + page_start;
+      continue;
+    }
+    auto offset = find_in_page_range (words, page_start, page_end, skip);
+    if (offset != BITMAP_PAGE_BITS)
+      return page * BITMAP_PAGE_BITS + offset;
+  }
+  return end;
+}
+
+size_t
+bitmap$find_first_set (bitmap_t bitmap, size_t start, size_t end)
 {
   $strict_assert (
     start < end && end <= bitmap->size,
     "Invalid or out of bounds bitmap indices");
-  auto start_index = get_bitmap_index (bitmap, start);
-  auto end_index = get_bitmap_index (bitmap, end - 1);
+  return find_first_in_range (bitmap, start, end, 0);
+}
 
-  /* single-member case, e.g. `uint8_t` range [2, 6) */
-  if (start_index.idx == end_index.idx)
-    return bitmap->array[start_index.idx]
-      & $bits_range (start_index.offset, end_index.offset);
-
-  /* partial first index */
-  if (bitmap->array[start_index.idx] & $bits_from (start_index.offset))
-    return true;
-  
-  /* middle indices (if any) */
-  for (size_t i = start_index.idx + 1; i < end_index.idx; ++i)
-    if (bitmap->array[i])
-      return true;
-  
-  /* final index */
-  return bitmap->array[end_index.idx] & $bits_up_to (end_index.offset);
+size_t
+bitmap$find_first_clear (bitmap_t bitmap, size_t start, size_t end)
+{
+  $strict_assert (
+    start < end && end <= bitmap->size,
+    "Invalid or out of bounds bitmap indices");
+  return find_first_in_range (bitmap, start, end, UINT64_MAX);
 }
 
-bool
-bitmap$test_all_in_range (bitmap_t bitmap, size_t start, size_t end)
+size_t
+bitmap$popcount_range (bitmap_t bitmap, size_t start, size_t end)
 {
   $strict_assert (
     start < end && end <= bitmap->size,
     "Invalid or out of bounds bitmap indices");
-  auto start_index = get_bitmap_index (bitmap, start);
-  auto end_index = get_bitmap_index (bitmap, end - 1);
+  size_t total = 0;
+  $for_each_page_in_range (start, end, page, page_start, page_end)
+    if (bitmap->pages[page] != NULL)
+      total += popcount_page_range (bitmap->pages[page], page_start, page_end);
+  return total;
+}
 
-  if (start_index.idx == end_index.idx)
-  {
-    auto mask = $bits_range (start_index.offset, end_index.offset);
-    return (bitmap->array[start_index.idx] & mask) == mask;
-  }
+bool
+bitmap$test_any_in_range (bitmap_t bitmap, size_t start, size_t end)
+{
+  return bitmap$find_first_set (bitmap, start, end) != end;
+}
 
-  auto start_mask = $bits_from (start_index.offset);
-  if ((bitmap->array[start_index.idx] & start_mask) != start_mask)
-    return false;
-  
-  for (size_t i = start_index.idx + 1; i < end_index.idx; ++i)
-    if (bitmap->array[i] != (typeof (*bitmap->array))(-1))
-      return false;
-  
-  auto end_mask = $bits_up_to (end_index.offset);
-  return (bitmap->array[end_index.idx] & end_mask) == end_mask;
+bool
+bitmap$test_all_in_range (bitmap_t bitmap, size_t start, size_t end)
+{
+  return bitmap$find_first_clear (bitmap, start, end) == end;
 }
 
 size_t
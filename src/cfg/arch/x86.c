@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "cfg/arch/x86.h"
+#include "cfg/arch/x86-inline.h"
 #include "capstone/x86.h"
 
 static const char* const map_regname[] = {
@@ -41,115 +42,120 @@ static const char* const map_regname[] = {
   [REG_RIP] = "rip",
 };
 
-static uint64_t*
-get_regloc_mask (
-  struct cfg_sim_state_x86* state, enum x86_reg reg, uint64_t* mask)
-{
-  uint64_t tmp; (void)tmp;
-  if (mask == NULL)
-    mask = &tmp;
+/* register descriptors indexed by `enum x86_reg`, entries of registers the
+ * simulator doesn't model are left zeroed
+ */
+const struct cfg_sim_x86_reg_desc cfg_sim$x86$reg_descs[X86_REG_ENDING] = {
+#define $reg_desc(reg, part, _slot) \
+  [reg] = { \
+    .mask = REGMASK_##part, \
+    .slot = (_slot), \
+    .width = REGWIDTH_##part, \
+    .shift = REGSHIFT_##part, \
+    .is_valid = true \
+  }
 
-  switch (reg)
-  {
-#define $case_regloc_mask(_case, _mask, idx) \
-  case _case: *mask = (_mask); return &state->gpregs[idx];
-
-    $case_regloc_mask(X86_REG_AL, REGMASK_LOWB, REG_RAX);
-    $case_regloc_mask(X86_REG_AH, REGMASK_HIGHB, REG_RAX);
-    $case_regloc_mask(X86_REG_AX, REGMASK_WORD, REG_RAX);
-    $case_regloc_mask(X86_REG_EAX, REGMASK_DWORD, REG_RAX);
-    $case_regloc_mask(X86_REG_RAX, REGMASK_QWORD, REG_RAX);
-    
-    $case_regloc_mask(X86_REG_BL, REGMASK_LOWB, REG_RBX);
-    $case_regloc_mask(X86_REG_BH, REGMASK_HIGHB, REG_RBX);
-    $case_regloc_mask(X86_REG_BX, REGMASK_WORD, REG_RBX);
-    $case_regloc_mask(X86_REG_EBX, REGMASK_DWORD, REG_RBX);
-    $case_regloc_mask(X86_REG_RBX, REGMASK_QWORD, REG_RBX);
-
-    $case_regloc_mask(X86_REG_CL, REGMASK_LOWB, REG_RCX);
-    $case_regloc_mask(X86_REG_CH, REGMASK_HIGHB, REG_RCX);
-    $case_regloc_mask(X86_REG_CX, REGMASK_WORD, REG_RCX);
-    $case_regloc_mask(X86_REG_ECX, REGMASK_DWORD, REG_RCX);
-    $case_regloc_mask(X86_REG_RCX, REGMASK_QWORD, REG_RCX);
-
-    $case_regloc_mask(X86_REG_DL, REGMASK_LOWB, REG_RDX);
-    $case_regloc_mask(X86_REG_DH, REGMASK_HIGHB, REG_RDX);
-    $case_regloc_mask(X86_REG_DX, REGMASK_WORD, REG_RDX);
-    $case_regloc_mask(X86_REG_EDX, REGMASK_DWORD, REG_RDX);
-    $case_regloc_mask(X86_REG_RDX, REGMASK_QWORD, REG_RDX);
-
-    $case_regloc_mask(X86_REG_SIL, REGMASK_LOWB, REG_RSI);
-    $case_regloc_mask(X86_REG_SI, REGMASK_WORD, REG_RSI);
-    $case_regloc_mask(X86_REG_ESI, REGMASK_DWORD, REG_RSI);
-    $case_regloc_mask(X86_REG_RSI, REGMASK_QWORD, REG_RSI);
-
-    $case_regloc_mask(X86_REG_DIL, REGMASK_LOWB, REG_RDI);
-    $case_regloc_mask(X86_REG_DI, REGMASK_WORD, REG_RDI);
-    $case_regloc_mask(X86_REG_EDI, REGMASK_DWORD, REG_RDI);
-    $case_regloc_mask(X86_REG_RDI, REGMASK_QWORD, REG_RDI);
-
-    $case_regloc_mask(X86_REG_BPL, REGMASK_LOWB, REG_RBP);
-    $case_regloc_mask(X86_REG_BP, REGMASK_WORD, REG_RBP);
-    $case_regloc_mask(X86_REG_EBP, REGMASK_DWORD, REG_RBP);
-    $case_regloc_mask(X86_REG_RBP, REGMASK_QWORD, REG_RBP);
-
-    $case_regloc_mask(X86_REG_SPL, REGMASK_LOWB, REG_RSP);
-    $case_regloc_mask(X86_REG_SP, REGMASK_WORD, REG_RSP);
-    $case_regloc_mask(X86_REG_ESP, REGMASK_DWORD, REG_RSP);
-    $case_regloc_mask(X86_REG_RSP, REGMASK_QWORD, REG_RSP);
-
-    $case_regloc_mask(X86_REG_R8B, REGMASK_LOWB, REG_R8);
-    $case_regloc_mask(X86_REG_R8W, REGMASK_WORD, REG_R8);
-    $case_regloc_mask(X86_REG_R8D, REGMASK_DWORD, REG_R8);
-    $case_regloc_mask(X86_REG_R8, REGMASK_QWORD, REG_R8);
-
-    $case_regloc_mask(X86_REG_R9B, REGMASK_LOWB, REG_R9);
-    $case_regloc_mask(X86_REG_R9W, REGMASK_WORD, REG_R9);
-    $case_regloc_mask(X86_REG_R9D, REGMASK_DWORD, REG_R9);
-    $case_regloc_mask(X86_REG_R9, REGMASK_QWORD, REG_R9);
-
-    $case_regloc_mask(X86_REG_R10B, REGMASK_LOWB, REG_R10);
-    $case_regloc_mask(X86_REG_R10W, REGMASK_WORD, REG_R10);
-    $case_regloc_mask(X86_REG_R10D, REGMASK_DWORD, REG_R10);
-    $case_regloc_mask(X86_REG_R10, REGMASK_QWORD, REG_R10);
-
-    $case_regloc_mask(X86_REG_R11B, REGMASK_LOWB, REG_R11);
-    $case_regloc_mask(X86_REG_R11W, REGMASK_WORD, REG_R11);
-    $case_regloc_mask(X86_REG_R11D, REGMASK_DWORD, REG_R11);
-    $case_regloc_mask(X86_REG_R11, REGMASK_QWORD, REG_R11);
-
-    $case_regloc_mask(X86_REG_R12B, REGMASK_LOWB, REG_R12);
-    $case_regloc_mask(X86_REG_R12W, REGMASK_WORD, REG_R12);
-    $case_regloc_mask(X86_REG_R12D, REGMASK_DWORD, REG_R12);
-    $case_regloc_mask(X86_REG_R12, REGMASK_QWORD, REG_R12);
-
-    $case_regloc_mask(X86_REG_R13B, REGMASK_LOWB, REG_R13);
-    $case_regloc_mask(X86_REG_R13W, REGMASK_WORD, REG_R13);
-    $case_regloc_mask(X86_REG_R13D, REGMASK_DWORD, REG_R13);
-    $case_regloc_mask(X86_REG_R13, REGMASK_QWORD, REG_R13);
-
-    $case_regloc_mask(X86_REG_R14B, REGMASK_LOWB, REG_R14);
-    $case_regloc_mask(X86_REG_R14W, REGMASK_WORD, REG_R14);
-    $case_regloc_mask(X86_REG_R14D, REGMASK_DWORD, REG_R14);
-    $case_regloc_mask(X86_REG_R14, REGMASK_QWORD, REG_R14);
-
-    $case_regloc_mask(X86_REG_R15B, REGMASK_LOWB, REG_R15);
-    $case_regloc_mask(X86_REG_R15W, REGMASK_WORD, REG_R15);
-    $case_regloc_mask(X86_REG_R15D, REGMASK_DWORD, REG_R15);
-    $case_regloc_mask(X86_REG_R15, REGMASK_QWORD, REG_R15);
-
-    $case_regloc_mask(X86_REG_IP, REGMASK_WORD, REG_RIP);
-    $case_regloc_mask(X86_REG_EIP, REGMASK_DWORD, REG_RIP);
-    $case_regloc_mask(X86_REG_RIP, REGMASK_QWORD, REG_RIP);
-
-    case X86_REG_INVALID:
-      /* this might be valid in some cases? */
-      $abort ("tried to get location of invalid register");
+  $reg_desc(X86_REG_AL, LOWB, REG_RAX),
+  $reg_desc(X86_REG_AH, HIGHB, REG_RAX),
+  $reg_desc(X86_REG_AX, WORD, REG_RAX),
+  $reg_desc(X86_REG_EAX, DWORD, REG_RAX),
+  $reg_desc(X86_REG_RAX, QWORD, REG_RAX),
+
+  $reg_desc(X86_REG_BL, LOWB, REG_RBX),
+  $reg_desc(X86_REG_BH, HIGHB, REG_RBX),
+  $reg_desc(X86_REG_BX, WORD, REG_RBX),
+  $reg_desc(X86_REG_EBX, DWORD, REG_RBX),
+  $reg_desc(X86_REG_RBX, QWORD, REG_RBX),
+
+  $reg_desc(X86_REG_CL, LOWB, REG_RCX),
+  $reg_desc(X86_REG_CH, HIGHB, REG_RCX),
+  $reg_desc(X86_REG_CX, WORD, REG_RCX),
+  $reg_desc(X86_REG_ECX, DWORD, REG_RCX),
+  $reg_desc(X86_REG_RCX, QWORD, REG_RCX),
+
+  $reg_desc(X86_REG_DL, LOWB, REG_RDX),
+  $reg_desc(X86_REG_DH, HIGHB, REG_RDX),
+  $reg_desc(X86_REG_DX, WORD, REG_RDX),
+  $reg_desc(X86_REG_EDX, DWORD, REG_RDX),
+  $reg_desc(X86_REG_RDX, QWORD, REG_RDX),
+
+  $reg_desc(X86_REG_SIL, LOWB, REG_RSI),
+  $reg_desc(X86_REG_SI, WORD, REG_RSI),
+  $reg_desc(X86_REG_ESI, DWORD, REG_RSI),
+  $reg_desc(X86_REG_RSI, QWORD, REG_RSI),
+
+  $reg_desc(X86_REG_DIL, LOWB, REG_RDI),
+  $reg_desc(X86_REG_DI, WORD, REG_RDI),
+  $reg_desc(X86_REG_EDI, DWORD, REG_RDI),
+  $reg_desc(X86_REG_RDI, QWORD, REG_RDI),
+
+  $reg_desc(X86_REG_BPL, LOWB, REG_RBP),
+  $reg_desc(X86_REG_BP, WORD, REG_RBP),
+  $reg_desc(X86_REG_EBP, DWORD, REG_RBP),
+  $reg_desc(X86_REG_RBP, QWORD, REG_RBP),
+
+  $reg_desc(X86_REG_SPL, LOWB, REG_RSP),
+  $reg_desc(X86_REG_SP, WORD, REG_RSP),
+  $reg_desc(X86_REG_ESP, DWORD, REG_RSP),
+  $reg_desc(X86_REG_RSP, QWORD, REG_RSP),
+
+  $reg_desc(X86_REG_R8B, LOWB, REG_R8),
+  $reg_desc(X86_REG_R8W, WORD, REG_R8),
+  $reg_desc(X86_REG_R8D, DWORD, REG_R8),
+  $reg_desc(X86_REG_R8, QWORD, REG_R8),
+
+  $reg_desc(X86_REG_R9B, LOWB, REG_R9),
+  $reg_desc(X86_REG_R9W, WORD, REG_R9),
+  $reg_desc(X86_REG_R9D, DWORD, REG_R9),
+  $reg_desc(X86_REG_R9, QWORD, REG_R9),
+
+  $reg_desc(X86_REG_R10B, LOWB, REG_R10),
+  $reg_desc(X86_REG_R10W, WORD, REG_R10),
+  $reg_desc(X86_REG_R10D, DWORD, REG_R10),
+  $reg_desc(X86_REG_R10, QWORD, REG_R10),
+
+  $reg_desc(X86_REG_R11B, LOWB, REG_R11),
+  $reg_desc(X86_REG_R11W, WORD, REG_R11),
+  $reg_desc(X86_REG_R11D, DWORD, REG_R11),
+  $reg_desc(X86_REG_R11, QWORD, REG_R11),
+
+  $reg_desc(X86_REG_R12B, LOWB, REG_R12),
+  $reg_desc(X86_REG_R12W, WORD, REG_R12),
+  $reg_desc(X86_REG_R12D, DWORD, REG_R12),
+  $reg_desc(X86_REG_R12, QWORD, REG_R12),
+
+  $reg_desc(X86_REG_R13B, LOWB, REG_R13),
+  $reg_desc(X86_REG_R13W, WORD, REG_R13),
+  $reg_desc(X86_REG_R13D, DWORD, REG_R13),
+  $reg_desc(X86_REG_R13, QWORD, REG_R13),
+
+  $reg_desc(X86_REG_R14B, LOWB, REG_R14),
+  $reg_desc(X86_REG_R14W, WORD, REG_R14),
+  $reg_desc(X86_REG_R14D, DWORD, REG_R14),
+  $reg_desc(X86_REG_R14, QWORD, REG_R14),
+
+  $reg_desc(X86_REG_R15B, LOWB, REG_R15),
+  $reg_desc(X86_REG_R15W, WORD, REG_R15),
+  $reg_desc(X86_REG_R15D, DWORD, REG_R15),
+  $reg_desc(X86_REG_R15, QWORD, REG_R15),
+
+  $reg_desc(X86_REG_IP, WORD, REG_RIP),
+  $reg_desc(X86_REG_EIP, DWORD, REG_RIP),
+  $reg_desc(X86_REG_RIP, QWORD, REG_RIP),
+#undef $reg_desc
+};
 
-    default:
-      $abort ("unrecognised x86 register: %d", reg);
-#undef $case_regloc_mask
-  }
+uint64_t
+cfg_sim$x86$get_reg_bit (uint16_t _reg)
+{
+  auto reg = (enum x86_reg)_reg;
+  if (reg == X86_REG_EFLAGS)
+    return CFG_SIM_X86_REGBIT_EFLAGS;
+
+  auto desc = $cfg_sim_x86_reg_desc (reg);
+  if (desc == NULL)
+    return CFG_SIM_X86_REGBIT_OTHER;
+  return 1ull << desc->slot;
 }
 
 const char*
@@ -158,31 +164,10 @@ cfg_sim$x86$get_reg_name (void* _state, uint16_t _reg)
   auto state = (struct cfg_sim_state_x86 *)_state;
   auto reg = (enum x86_reg)_reg;
 
-  uint64_t mask; (void)mask;
-  auto reg_offs = get_regloc_mask (state, reg, &mask);
+  auto reg_offs = cfg_sim$x86$inline_get_regloc_mask (state, reg, NULL);
   return map_regname[reg_offs - state->gpregs];
 }
 
-static inline bool
-is_dirty_bit_set (struct cfg_sim_state_x86* state, uint64_t* regloc)
-{
-  $strict_assert (
-    (state->gpregs <= regloc)
-      && (regloc < (state->gpregs + $arraysize (state->gpregs))),
-    "Invalid register location");
-  return state->bitmap_gpregs & (1ull << (regloc - state->gpregs));
-}
-
-static inline void
-set_dirty_bit (struct cfg_sim_state_x86* state, uint64_t* regloc)
-{
-  $strict_assert (
-    (state->gpregs <= regloc)
-      && (regloc < (state->gpregs + $arraysize (state->gpregs))),
-    "Invalid register location");
-  state->bitmap_gpregs |= 1ull << (regloc - state->gpregs);
-}
-
 void*
 cfg_sim$x86$new_state (void)
 {
@@ -200,107 +185,146 @@ cfg_sim$x86$reset (void* _state)
 {
   auto state = (struct cfg_sim_state_x86 *)_state;
   memset (state->gpregs, 0, sizeof (state->gpregs));
-  state->bitmap_gpregs = state->flags = 0;
+  state->bitmap_gpregs = state->flags = state->lazy_flags = 0;
+  state->cc = (struct cfg_sim_cc){0};
 }
 
 uint64_t*
-cfg_sim$x86$get_reg_indet (void* _state, uint64_t* mask, uint16_t _reg)
+cfg_sim$x86$get_reg_indet (void* state, uint64_t* mask, uint16_t reg)
 {
-  auto state = (struct cfg_sim_state_x86 *)_state;
-  auto reg = (enum x86_reg)_reg;
-  return get_regloc_mask (state, reg, mask);
+  return cfg_sim$x86$inline_get_regloc_mask (state, (enum x86_reg)reg, mask);
 }
 
-uint64_t*
-cfg_sim$x86$get_reg (void* _state, uint64_t* mask, uint16_t _reg)
+bool
+cfg_sim$x86$get_reg (
+  void* state, uint64_t* mask, uint16_t reg, uint64_t* val)
 {
-  auto state = (struct cfg_sim_state_x86 *)_state;
-  auto regloc = cfg_sim$x86$get_reg_indet (_state, mask, _reg);
-
-  if (!is_dirty_bit_set (state, regloc))
-    return NULL;
-
-  return regloc;
+  return cfg_sim$x86$inline_get_reg (state, mask, reg, val);
 }
 
 void
-cfg_sim$x86$set_reg (void* _state, uint16_t _reg, uint64_t val)
+cfg_sim$x86$set_reg (void* state, uint16_t reg, uint64_t val)
 {
-  auto state = (struct cfg_sim_state_x86 *)_state;
-  auto reg = (enum x86_reg)_reg;
-
-  uint64_t mask;
-  uint64_t* regloc = get_regloc_mask (state, reg, &mask);
-  
-  /* NB: writing to 32-bit registers clears the upper 32 bits of the 64-bit
-   *     variant
-   */
-  if (mask == REGMASK_DWORD)
-    *regloc = val & REGMASK_DWORD;
-  else
-    *regloc = (*regloc & ~mask) | (val & mask);
-
-  set_dirty_bit (state, regloc);
+  cfg_sim$x86$inline_set_reg (state, reg, val);
 }
 
 void
-cfg_sim$x86$set_pc (void* _state, uint64_t val)
+cfg_sim$x86$set_pc (void* state, uint64_t val)
 {
-  auto state = (struct cfg_sim_state_x86 *)_state;
-  cfg_sim$x86$set_reg (state, X86_REG_RIP, val);
+  cfg_sim$x86$inline_set_reg (state, X86_REG_RIP, val);
 }
 
 uint8_t
-cfg_sim$x86$get_reg_width (void* _state, uint16_t _reg)
+cfg_sim$x86$get_reg_width (void* state, uint16_t reg)
 {
-  auto state = (struct cfg_sim_state_x86 *)_state;
-  auto reg = (enum x86_reg)_reg;
+  (void)state;
+  return cfg_sim$x86$inline_get_reg_width (reg);
+}
+
+static uint64_t
+compute_cc_flags (const struct cfg_sim_cc* cc, uint64_t mask)
+{
+  auto val = cc->result;
+  auto msb_mask = 1ull << (cc->width - 1);
+  uint64_t flags = 0;
 
-  uint64_t mask;
-  (void)get_regloc_mask (state, reg, &mask);
+#define $compute_flag(flag, expr) \
+  if ((mask & (flag)) && (expr)) \
+    flags |= (flag);
+
+  $compute_flag(EFLAGS_ZF, !val);
+  $compute_flag(EFLAGS_SF, val & msb_mask);
+  $compute_flag(EFLAGS_PF, !(__builtin_popcountg (val & 0xff) & 1));
+
+  switch (cc->op)
+  {
+    case CFG_SIM_CC_ADD:
+    case CFG_SIM_CC_SUB:
+    {
+      bool is_sub = cc->op == CFG_SIM_CC_SUB;
+      auto sgn_op_1 = cc->src_1 & msb_mask;
+      auto sgn_op_2 = cc->src_2 & msb_mask;
+      auto res_sign = val & msb_mask;
+      $compute_flag(EFLAGS_CF, is_sub ? cc->src_1 < cc->src_2 : val < cc->src_1);
+      $compute_flag(
+        EFLAGS_OF,
+        (is_sub ? (sgn_op_1 != sgn_op_2) : (sgn_op_1 == sgn_op_2))
+          && (sgn_op_1 != res_sign));
+      $compute_flag(EFLAGS_AF, ((cc->src_1 ^ cc->src_2 ^ val) >> 4) & 1);
+      break;
+    }
+
+    case CFG_SIM_CC_INC:
+    case CFG_SIM_CC_DEC:
+      $compute_flag(
+        EFLAGS_OF,
+        cc->src_1 == ((cc->op == CFG_SIM_CC_DEC) ? msb_mask : msb_mask - 1));
+      $compute_flag(EFLAGS_AF, ((cc->src_1 ^ val) >> 4) & 1);
+      break;
+
+    case CFG_SIM_CC_SHL:
+    case CFG_SIM_CC_SHR:
+      $compute_flag(EFLAGS_CF, cc->src_2);
+      $compute_flag(
+        EFLAGS_OF,
+        (cc->op == CFG_SIM_CC_SHL)
+          ? cc->src_2 ^ !!(val & msb_mask)
+          : cc->src_2);
+      break;
 
-  return __builtin_popcountg (mask);
+    default:
+      /* logic operations clear CF and OF */
+      break;
+  }
+#undef $compute_flag
+
+  return flags;
 }
 
 uint64_t
-cfg_sim$x86$get_flags (void* _state)
+cfg_sim$x86$get_flags (void* _state, uint64_t mask)
 {
   /* N.B.: the flags are already in correct order for x86, but will need to be
    *       restructured for other architectures; the `set_flag`/`clear_flag`
    *       functions should be architecture-agnostic, but `get_flags` should
    *       return a proper `eflags` register.
    */
-  return ((struct cfg_sim_state_x86 *)_state)->flags;
+  auto state = (struct cfg_sim_state_x86 *)_state;
+  auto lazy = mask & state->lazy_flags;
+  if (lazy)
+  {
+    state->flags = (state->flags & ~lazy) | compute_cc_flags (&state->cc, lazy);
+    state->lazy_flags &= ~lazy;
+  }
+  return state->flags;
+}
+
+void
+cfg_sim$x86$set_flags_lazy (void* state, const struct cfg_sim_cc* cc)
+{
+  cfg_sim$x86$inline_set_flags_lazy (state, cc);
 }
 
 uint8_t*
-cfg_sim$x86$get_stack_frame (void* _state)
+cfg_sim$x86$get_stack_frame (void* state)
 {
-  return *(uint8_t **)cfg_sim$x86$get_reg_indet (_state, NULL, X86_REG_RSP);
+  return cfg_sim$x86$inline_get_stack_frame (state);
 }
 
 void
-cfg_sim$x86$push_stack (void* _state, void* ptr, size_t size)
+cfg_sim$x86$push_stack (void* state, void* ptr, size_t size)
 {
-  auto stack = cfg_sim$x86$get_stack_frame (_state);
-  stack = memcpy (stack - size, ptr, size);
-  cfg_sim$x86$set_reg (_state, X86_REG_RSP, (uintptr_t)stack);
+  cfg_sim$x86$inline_push_stack (state, ptr, size);
 }
 
 void
-cfg_sim$x86$pop_stack (void* _state, void* dst, size_t size)
+cfg_sim$x86$pop_stack (void* state, void* dst, size_t size)
 {
-  auto stack = cfg_sim$x86$get_stack_frame (_state);
-  memcpy (dst, stack, size);
-  cfg_sim$x86$set_reg (_state, X86_REG_RSP, (uintptr_t)(stack + size));
+  cfg_sim$x86$inline_pop_stack (state, dst, size);
 }
 
 void
-cfg_sim$x86$set_flag (void* _state, uint64_t mask, bool val)
+cfg_sim$x86$set_flag (void* state, uint64_t mask, bool val)
 {
-  auto state = (struct cfg_sim_state_x86 *)_state;
-  if (val)
-    state->flags |= mask;
-  else
-    state->flags &= ~mask;
+  cfg_sim$x86$inline_set_flag (state, mask, val);
 }
\ No newline at end of file
@@ -0,0 +1,333 @@
+#include "cfg/cfg-decode.h"
+#include "arena.h"
+#include "array.h"
+#include "map.h"
+
+struct decode_run
+{
+  cs_insn* insns;
+  size_t count;
+};
+
+struct _cfg_decode_cache
+{
+  pe_context_t pe;
+  csh scan_handle, detail_handle;
+  /* owns every run, and the details of every instruction in them */
+  arena_t arena;
+  /* reused by `cs_disasm_iter` for each instruction decoded */
+  cs_insn* scratch_insn;
+  cs_insn* scratch_detail_insn;
+  array_t /* cs_insn */ scratch_insns;
+  array_t /* cs_detail */ scratch_details;
+  array_t /* struct decode_run */ runs;
+  /* instruction address -> (run << 32 | index) + 1 */
+  map_t map_address_insn;
+  struct cfg_decode_stats stats;
+};
+
+struct insn_location
+{
+  uint32_t run, idx;
+};
+
+static void*
+pack_location (size_t run, size_t idx)
+{
+  return (void *)(uintptr_t)(((uint64_t)run << 32 | idx) + 1);
+}
+
+static bool
+find_location (
+  cfg_decode_cache_t cache, uint64_t address, struct insn_location* location)
+{
+  uint64_t packed = (uintptr_t)map$get (cache->map_address_insn, address);
+  if (!packed--)
+    return false;
+  *location = (struct insn_location){
+    .run = packed >> 32,
+    .idx = (uint32_t)packed
+  };
+  return true;
+}
+
+/* NB: the only mutable access to cached instructions, they're `const` to
+ *     everyone outside the cache
+ */
+static cs_insn*
+get_insn (cfg_decode_cache_t cache, struct insn_location location)
+{
+  struct decode_run* run = array$at (cache->runs, location.run);
+  return &run->insns[location.idx];
+}
+
+static const uint8_t*
+acquire_code (cfg_decode_cache_t cache, uint64_t rva, uint64_t* size)
+{
+  /* borrowed straight out of the image when it's mapped, otherwise an owned
+   * copy read from the stream. `size` may be shortened to the end of the
+   * containing section
+   */
+  if (pe$is_image_mapped (cache->pe))
+  {
+    uint64_t len;
+    auto view = pe$view_rva (cache->pe, rva, &len);
+    if (view != NULL)
+      *size = $min (*size, len);
+    return view;
+  }
+  auto section = pe$find_section_by_rva (cache->pe, rva);
+  if (section != NULL)
+  {
+    uint64_t raw_end = section->virtual_address + section->size_of_raw_data;
+    if (rva >= raw_end)
+      return NULL;
+    *size = $min (*size, raw_end - rva);
+  }
+  return pe$read_sized (cache->pe, rva, *size);
+}
+
+static void
+release_code (cfg_decode_cache_t cache, const uint8_t* code)
+{
+  if (!pe$is_image_mapped (cache->pe))
+    $chk_free ((uint8_t *)code);
+}
+
+static bool
+decode_run_at (cfg_decode_cache_t cache, uint64_t address)
+{
+  uint64_t code_size = pe$get_pagesize (cache->pe);
+  auto code = acquire_code (cache, address, &code_size);
+  if (code == NULL)
+  {
+    $trace ("failed to read page at %" PRIx64, address);
+    return false;
+  }
+  cache->stats.misses++;
+
+  /* a run ends after the first branch, so decoding is proportional to the
+   * block rather than the page. it also stops short of anything already
+   * decoded, so runs never overlap and each address maps to exactly one
+   * instruction
+   */
+  auto insn = cache->scratch_insn;
+  const uint8_t* cursor = code;
+  size_t remaining = code_size;
+  uint64_t cursor_address = address;
+  while (cs_disasm_iter (
+      cache->scan_handle, &cursor, &remaining, &cursor_address, insn))
+  {
+    if (map$contains (cache->map_address_insn, insn->address))
+      break;
+    array$append (cache->scratch_insns, insn);
+    if (insn->detail != NULL)
+      array$append (cache->scratch_details, insn->detail);
+    cache->stats.bytes_decoded += insn->size;
+    if (cfg_decode$get_branch_kind (insn) != CFG_BRANCH_NONE)
+      break;
+  }
+  release_code (cache, code);
+
+  auto count = array$length (cache->scratch_insns);
+  if (!count)
+    return false;
+
+  auto run_idx = array$length (cache->runs);
+  struct decode_run run = {
+    .insns = arena$alloc (cache->arena, count * sizeof (cs_insn)),
+    .count = count
+  };
+  auto has_detail = !array$is_empty (cache->scratch_details);
+  cs_detail* details = has_detail
+    ? arena$alloc (cache->arena, count * sizeof (cs_detail))
+    : NULL;
+  for (size_t i = 0; i < count; ++i)
+  {
+    run.insns[i] = *(cs_insn *)array$at (cache->scratch_insns, i);
+    if (has_detail)
+    {
+      details[i] = *(cs_detail *)array$at (cache->scratch_details, i);
+      run.insns[i].detail = &details[i];
+    }
+    map$set (
+      cache->map_address_insn, run.insns[i].address,
+      pack_location (run_idx, i));
+  }
+  array$append (cache->runs, &run);
+  array$clear (cache->scratch_insns);
+  array$clear (cache->scratch_details);
+
+  cache->stats.insns_decoded += count;
+  $trace_debug ("decoded run of %zu insns at %" PRIx64, count, address);
+  return true;
+}
+
+cfg_decode_cache_t
+cfg_decode$new (pe_context_t pe_context, csh scan_handle, csh detail_handle)
+{
+  auto cache = $chk_allocty (cfg_decode_cache_t);
+  cache->pe = pe_context;
+  cache->scan_handle = scan_handle;
+  cache->detail_handle = detail_handle;
+  cache->arena = arena$new ();
+  cache->scratch_insn = cs_malloc (scan_handle);
+  cache->scratch_detail_insn = cs_malloc (detail_handle);
+  cache->scratch_insns = array$new (sizeof (cs_insn));
+  cache->scratch_details = array$new (sizeof (cs_detail));
+  cache->runs = array$new (sizeof (struct decode_run));
+  cache->map_address_insn = map$new ();
+  return cache;
+}
+
+void
+cfg_decode$free (cfg_decode_cache_t cache)
+{
+  $trace_debug (
+    "freeing decode cache: %zu hits, %zu misses, %zu insns decoded, "
+    "%zu details decoded",
+    cache->stats.hits, cache->stats.misses, cache->stats.insns_decoded,
+    cache->stats.details_decoded);
+  cs_free (cache->scratch_insn, 1);
+  cs_free (cache->scratch_detail_insn, 1);
+  array$free (cache->scratch_insns);
+  array$free (cache->scratch_details);
+  array$free (cache->runs);
+  arena$free (cache->arena);
+  map$free (cache->map_address_insn);
+  $chk_free (cache);
+}
+
+const cs_insn*
+cfg_decode$insn_at (cfg_decode_cache_t cache, uint64_t address)
+{
+  struct insn_location location;
+  if (find_location (cache, address, &location))
+  {
+    cache->stats.hits++;
+    return get_insn (cache, location);
+  }
+  if (!decode_run_at (cache, address)
+      || !find_location (cache, address, &location))
+    return NULL;
+  return get_insn (cache, location);
+}
+
+const cs_insn*
+cfg_decode$next (cfg_decode_cache_t cache, const cs_insn* insn)
+{
+  struct insn_location location;
+  if (find_location (cache, insn->address, &location))
+  {
+    struct decode_run* run = array$at (cache->runs, location.run);
+    if (location.idx + 1 < run->count)
+    {
+      cache->stats.hits++;
+      return &run->insns[location.idx + 1];
+    }
+  }
+  return cfg_decode$insn_at (cache, insn->address + insn->size);
+}
+
+const cs_insn*
+cfg_decode$detail (cfg_decode_cache_t cache, const cs_insn* insn)
+{
+  if (insn->detail != NULL)
+    return insn;
+
+  struct insn_location location;
+  if (!find_location (cache, insn->address, &location))
+  {
+    $trace_err ("instruction at %" PRIx64 " isn't cached", insn->address);
+    return NULL;
+  }
+  auto cached = get_insn (cache, location);
+
+  /* the cached instruction carries its own bytes, so the image isn't needed */
+  const uint8_t* code = insn->bytes;
+  size_t code_size = insn->size;
+  uint64_t address = insn->address;
+  auto detailed = cache->scratch_detail_insn;
+  if (!cs_disasm_iter (
+        cache->detail_handle, &code, &code_size, &address, detailed)
+      || detailed->detail == NULL)
+  {
+    $trace_err ("failed to decode detail at %" PRIx64, insn->address);
+    return NULL;
+  }
+  cs_detail* detail = arena$alloc (cache->arena, sizeof (*detail));
+  *detail = *detailed->detail;
+  cached->detail = detail;
+  cache->stats.details_decoded++;
+  return cached;
+}
+
+enum cfg_branch_kind
+cfg_decode$get_branch_kind (const cs_insn* insn)
+{
+  /* mirrors capstone's JUMP/CALL/RET groups, without needing detail */
+  switch (insn->id)
+  {
+    case X86_INS_JMP:
+    case X86_INS_LJMP:
+    case X86_INS_JAE:
+    case X86_INS_JA:
+    case X86_INS_JBE:
+    case X86_INS_JB:
+    case X86_INS_JCXZ:
+    case X86_INS_JECXZ:
+    case X86_INS_JE:
+    case X86_INS_JGE:
+    case X86_INS_JG:
+    case X86_INS_JLE:
+    case X86_INS_JL:
+    case X86_INS_JNE:
+    case X86_INS_JNO:
+    case X86_INS_JNP:
+    case X86_INS_JNS:
+    case X86_INS_JO:
+    case X86_INS_JP:
+    case X86_INS_JRCXZ:
+    case X86_INS_JS:
+    case X86_INS_LOOP:
+    case X86_INS_LOOPE:
+    case X86_INS_LOOPNE:
+      return CFG_BRANCH_JUMP;
+    case X86_INS_CALL:
+    case X86_INS_LCALL:
+      return CFG_BRANCH_CALL;
+    case X86_INS_RET:
+    case X86_INS_RETF:
+    case X86_INS_RETFQ:
+      return CFG_BRANCH_RET;
+    default:
+      return CFG_BRANCH_NONE;
+  }
+}
+
+bool
+cfg_decode$read_range (
+  cfg_decode_cache_t cache, uint64_t start, uint64_t end, bool with_detail,
+  array_t into)
+{
+  if (start >= end)
+    return true;
+  for (auto insn = cfg_decode$insn_at (cache, start); insn != NULL;
+       insn = cfg_decode$next (cache, insn))
+  {
+    if (with_detail && cfg_decode$detail (cache, insn) == NULL)
+      return false;
+    array$append (into, &insn);
+    auto insn_end = insn->address + insn->size;
+    if (insn_end >= end)
+      return insn_end == end;
+  }
+  $trace ("failed to decode range %" PRIx64 "-%" PRIx64, start, end);
+  return false;
+}
+
+struct cfg_decode_stats
+cfg_decode$get_stats (cfg_decode_cache_t cache)
+{
+  return cache->stats;
+}
\ No newline at end of file
@@ -4,82 +4,111 @@
 
 #include "cfg/cfg-gen.h"
 #include "capstone/x86.h"
+#include "cfg/cfg-decode.h"
+#include "cfg/cfg-ir.h"
 #include "cfg/cfg-sim.h"
+#include "cfg/arch/x86.h"
 #include "cfg/cfg.h"
+#include "bitmap.h"
 #include "generic.h"
 #include "graph.h"
+#include "map.h"
+
+#define MAX_BRANCH_SEARCH_PAGES (3)
+
+enum cfg_gen_item_kind
+{
+  /* a function entry, `pred` is the calling function block if any */
+  CFG_GEN_ITEM_FUNCTION,
+  /* a jump target in `fn_tag`, `pred` is the jumping basic block */
+  CFG_GEN_ITEM_BLOCK
+};
+
+/* a unit of generator work, carrying the function it belongs to so nothing
+ * about the current function is kept on the context
+ */
+struct cfg_gen_item
+{
+  uint8_t kind; /* enum cfg_gen_item_kind */
+  vertex_tag_t fn_tag;
+  vertex_tag_t pred;
+  uint64_t address;
+};
 
 struct _cfg_gen_ctx
 {
   pe_context_t pe;
   cfg_sim_ctx_t sim;
   cfg_t cfg;
+  /* NB: the detail handle, the detail-free one is only used by the cache */
   csh handle;
-  vertex_tag_t fn_tag;
+  cfg_decode_cache_t decode_cache;
+  /* pending `struct cfg_gen_item`s, see `cfg_gen$generate` */
+  array_t worklist;
+  /* callees left for whoever schedules the generator, see
+   * `cfg_gen$set_defer_callees`
+   */
+  array_t /* struct cfg_gen_item */ deferred;
+  bool defer_callees;
+  /* how many predecessor blocks a dataflow slice may walk back */
+  size_t max_df_depth;
 };
 
-static cs_insn*
-read_insns_at (cfg_gen_ctx_t ctx, size_t* insn_count, uint64_t address)
+static const cs_insn*
+slice_at (array_t slice, size_t idx)
 {
-  uint8_t* page = pe$read_page_at (ctx->pe, address);
-  cs_insn* insns;
-  *insn_count = cs_disasm (
-    ctx->handle, page, pe$get_pagesize (ctx->pe), address, 0, &insns);
-  $chk_free (page);
-  return insns;
+  return *(const cs_insn **)array$at (slice, idx);
 }
 
 static inline bool
-is_load_insn (cs_insn* insn)
+is_load_insn (const cs_insn* insn)
 {
   /* TODO: SIMD has more complex load instructions */
   return !strncmp (insn->mnemonic, "mov", 3) || (insn->id == X86_INS_LEA);
 }
 
-static cs_insn*
-read_insns_at_block (
-  cfg_gen_ctx_t ctx, size_t* insn_count, vertex_tag_t basic_tag)
+static array_t /* const cs_insn* */
+read_insns_in_range (cfg_gen_ctx_t ctx, uint64_t start, uint64_t end)
 {
-  auto block_size = cfg$get_basic_block_size (
-    ctx->cfg, ctx->fn_tag, basic_tag);
-  auto block_rva = cfg$get_basic_block_rva (
-    ctx->cfg, ctx->fn_tag, basic_tag);
-  auto insn_raw = pe$read_sized (ctx->pe, block_rva, block_size);
-  if (insn_raw == NULL)
+  auto insns = array$new (sizeof (const cs_insn *));
+  if (!cfg_decode$read_range (ctx->decode_cache, start, end, true, insns))
   {
     $trace (
       "failed to read block at %" PRIx64 " (%" PRIu64 " bytes)",
-      block_rva, block_size);
+      start, end - start);
+    array$free (insns);
     return NULL;
   }
-  cs_insn* insns;
-  *insn_count = cs_disasm (
-    ctx->handle, insn_raw, block_size, block_rva, 0, &insns);
-  $chk_free (insn_raw);
   return insns;
 }
 
-static cs_insn*
+static array_t /* const cs_insn* */
+read_insns_at_block (
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
+{
+  auto block_size = cfg$get_basic_block_size (
+    ctx->cfg, fn_tag, basic_tag);
+  auto block_rva = cfg$get_basic_block_rva (
+    ctx->cfg, fn_tag, basic_tag);
+  return read_insns_in_range (ctx, block_rva, block_rva + block_size);
+}
+
+static array_t /* const cs_insn* */
 read_insns_at_block_before (
-  cfg_gen_ctx_t ctx, size_t* insn_count, vertex_tag_t basic_tag, uint64_t address)
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, vertex_tag_t basic_tag,
+  uint64_t address)
 {
-  auto block_rva = cfg$get_basic_block_rva (ctx->cfg, ctx->fn_tag, basic_tag);
+  auto block_rva = cfg$get_basic_block_rva (ctx->cfg, fn_tag, basic_tag);
   $strict_assert (
     (block_rva <= address)
     && (address < block_rva
-        + cfg$get_basic_block_size (ctx->cfg, ctx->fn_tag, basic_tag)),
+        + cfg$get_basic_block_size (ctx->cfg, fn_tag, basic_tag)),
     "Address specified not in bounds of block given");
-  auto block_size = address - block_rva;
-  auto insn_raw = pe$read_sized (ctx->pe, block_rva, block_size);
-  cs_insn* insns;
-  *insn_count = cs_disasm (
-    ctx->handle, insn_raw, block_size, block_rva, 0, &insns);
-  $chk_free (insn_raw);
-  return insns;
+  return read_insns_in_range (ctx, block_rva, address);
 }
 
 static bool
-branch_would_take (cs_insn* branch, uint64_t eflags)
+branch_would_take (const cs_insn* branch, uint64_t eflags)
 {
   bool zf = !!(eflags & EFLAGS_ZF);
   bool cf = !!(eflags & EFLAGS_CF);
@@ -114,47 +143,7 @@ branch_would_take (cs_insn* branch, uint64_t eflags)
 }
 
 static uint64_t
-get_insn_modified_flags (cs_insn* insn)
-{
-  auto eflags = insn->detail->x86.eflags;
-  uint64_t ret = 0;
-
-#define $check_modify(flag) \
-  if (eflags & (X86_EFLAGS_MODIFY_##flag | X86_EFLAGS_SET_##flag)) \
-    ret |= EFLAGS_##flag;
-
-  $check_modify(OF);
-  $check_modify(SF);
-  $check_modify(ZF);
-  $check_modify(PF);
-  $check_modify(CF);
-  $check_modify(AF);
-  $check_modify(DF);
-  $check_modify(IF);
-
-#undef $check_modify
-  return ret;
-}
-
-static uint64_t
-get_insn_tested_flags (cs_insn* insn)
-{
-  auto eflags = insn->detail->x86.eflags;
-  uint64_t ret = 0;
-
-  if (eflags & X86_EFLAGS_TEST_OF) ret |= EFLAGS_OF;
-  if (eflags & X86_EFLAGS_TEST_SF) ret |= EFLAGS_SF;
-  if (eflags & X86_EFLAGS_TEST_ZF) ret |= EFLAGS_ZF;
-  if (eflags & X86_EFLAGS_TEST_PF) ret |= EFLAGS_PF;
-  if (eflags & X86_EFLAGS_TEST_CF) ret |= EFLAGS_CF;
-  if (eflags & X86_EFLAGS_TEST_AF) ret |= EFLAGS_AF;
-  if (eflags & X86_EFLAGS_TEST_TF) ret |= EFLAGS_TF;
-
-  return ret;
-}
-
-static uint64_t
-get_insn_flags (cs_insn* insn)
+get_insn_flags (const cs_insn* insn)
 {
   /* rarely do instructions both check and set flags, so this should be
    * sufficent to understand what an instruction is doing, in context,
@@ -185,7 +174,8 @@ get_insn_flags (cs_insn* insn)
 }
 
 static inline bool
-is_equal_ops (struct cs_x86_op* dst_loc, struct cs_x86_op* src_loc)
+is_equal_ops (
+  const struct cs_x86_op* dst_loc, const struct cs_x86_op* src_loc)
 {
   if (dst_loc->type != src_loc->type)
     return false;
@@ -202,216 +192,289 @@ is_equal_ops (struct cs_x86_op* dst_loc, struct cs_x86_op* src_loc)
   }
 }
 
-static void /* struct cs_insn */
-trace_reg_block_dataflow (
-  cfg_gen_ctx_t ctx, vertex_tag_t basic_tag, cs_insn* insns,
-  size_t insn_count_or_depth, array_t df_insns, array_t tracked_regs,
-  array_t tracked_mem, array_t visited_blocks)
+struct df_slice_item
 {
-  size_t insn_count = insn_count_or_depth;
-  size_t depth = 0;
+  vertex_tag_t basic_tag;
+  size_t depth;
+};
 
-  if (array$contains_rval (visited_blocks, basic_tag))
+struct df_slice_state
+{
+  /* canonical register mask, see `cfg_sim$x86$get_reg_bit` */
+  uint64_t tracked_regs;
+  map_t /* cfg_memloc_t -> (void *)1 */ tracked_mem;
+  /* scratch IR of the block being sliced */
+  cfg_ir_t block_insns;
+  /* built back to front */
+  cfg_ir_t df_insns;
+};
+
+static void
+lower_block (
+  cfg_gen_ctx_t ctx, cfg_ir_t block, array_t /* const cs_insn* */ insns)
+{
+  cfg_ir$clear (block);
+  /* NB: instructions that fail to lower are left out of the slice */
+  $array_for_each ($, insns, const cs_insn*, ptrinsn)
   {
-    $trace ("ALREADY VISITED BLOCK: %" PRIx64, basic_tag);
-    return;
+    cfg_ir$append_insn (block, ctx->handle, *$.ptrinsn);
   }
-  array$append_rval (visited_blocks, basic_tag);
+}
 
-  if (insns == NULL)
+static const struct cfg_block_summary*
+summarize_block (
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, vertex_tag_t basic_tag,
+  cfg_ir_t block)
+{
+  if (cfg_ir$length (block) >= UINT16_MAX)
+    return NULL;
+
+  struct cfg_block_summary summary = {0};
+  for (size_t i = 0; i < cfg_ir$length (block); ++i)
   {
-    if (insn_count_or_depth > MAX_DF_BLOCK_DEPTH)
+    summary.regs_used |= block->regs_read[i] & ~summary.regs_defined;
+    summary.regs_defined |= block->regs_written[i];
+    summary.flags_modified |= block->flags_modified[i];
+    for (auto written = block->regs_written[i]; written; written &= written - 1)
+      summary.last_def[__builtin_ctzll (written)] = i + 1;
+
+    auto op_count = $min (block->op_count[i], CFG_IR_MAX_OPERANDS);
+    for (uint8_t j = 0; j < op_count; ++j)
     {
-      $trace_err ("exceeded maximum dataflow analysis depth");
-      return;
+      if (block->operands[i][j].type != CFG_IR_OP_MEM)
+        continue;
+      /* NB: matches what the slicer treats as a store */
+      if (!j && (block->op_count[i] == 2))
+        summary.mem_stores++;
+      else
+        summary.mem_loads++;
     }
-    depth = insn_count_or_depth;
-    insns = read_insns_at_block (ctx, &insn_count, basic_tag);
   }
 
-  $trace ("-> AT BLOCK (%zu insns): %" PRIx64, insn_count, basic_tag);
-  for (ssize_t i = insn_count - 1; i >= 0; --i)
-  {
-    auto insn = &insns[i];
+  cfg$set_basic_block_summary (ctx->cfg, fn_tag, basic_tag, &summary);
+  return cfg$get_basic_block_summary (ctx->cfg, fn_tag, basic_tag);
+}
 
-    uint8_t regs_write_count, regs_read_count;
-    cs_regs regs_write, regs_read;
-    if (cs_regs_access (
-        ctx->handle, insn, regs_read, &regs_read_count, regs_write,
-        &regs_write_count) != CS_ERR_OK)
-    {
-      $trace_err ("cs_regs_access failed");
-      continue;
-    }
+static inline bool
+is_store_relevant (
+  struct df_slice_state* state, const struct cfg_block_summary* summary)
+{
+  return summary->mem_stores && !map$is_empty (state->tracked_mem);
+}
+
+static size_t
+get_slice_start (
+  struct df_slice_state* state, const struct cfg_block_summary* summary)
+{
+  /* nothing after the last definer of a tracked register can be part of the
+   * slice, unless it stores to tracked memory
+   */
+  if ((summary == NULL) || is_store_relevant (state, summary))
+    return cfg_ir$length (state->block_insns);
+
+  size_t start = 0;
+  for (auto defined = summary->regs_defined & state->tracked_regs; defined;
+       defined &= defined - 1)
+    start = $max (start, summary->last_def[__builtin_ctzll (defined)]);
+  return start;
+}
+
+static void
+slice_block (
+  struct df_slice_state* state, vertex_tag_t basic_tag,
+  const struct cfg_block_summary* summary)
+{
+  auto block = state->block_insns;
+  /* NB: the simulator sets the pc itself, so it's never worth tracking */
+  auto untracked_regs = cfg_sim$x86$get_reg_bit (X86_REG_RIP);
 
+  $trace (
+    "-> AT BLOCK (%zu insns): %" PRIx64, cfg_ir$length (block), basic_tag);
+  for (ssize_t i = get_slice_start (state, summary) - 1; i >= 0; --i)
+  {
     $trace_debug (
-      "CHECKING %s %s (read %" PRIu8 ", write %" PRIu8 ")",
-      insn->mnemonic, insn->op_str, regs_read_count, regs_write_count);
+      "CHECKING %s (read %" PRIx64 ", write %" PRIx64 ")",
+      block->mnemonic[i], block->regs_read[i], block->regs_written[i]);
 
-    if (insn->detail->x86.op_count == 2)
+    if (block->op_count[i] == 2)
     {
-      auto operands = insn->detail->x86.operands;
-      auto op_1 = &operands[0];
-      auto op_2 = &operands[1];
+      auto op_1 = &block->operands[i][0];
+      auto op_2 = &block->operands[i][1];
 
-      if (op_1->type == X86_OP_MEM)
+      if (op_1->type == CFG_IR_OP_MEM)
       {
-        if (!array$contains (tracked_mem, &op_1->mem))
+        cfg_memloc_t loc;
+        if (!cfg_ir$get_memloc (block, i, 0, &loc)
+            || !map$contains (state->tracked_mem, loc))
         {
           $trace_debug ("NO TRACKED MEM");
           continue;
         }
-        array$remove_lval (tracked_mem, &op_1->mem);
-        array$insert (df_insns, 0, insn);
-        $trace ("\t%s %s", insn->mnemonic, insn->op_str);
+        map$remove (state->tracked_mem, loc);
+        cfg_ir$append_row (state->df_insns, block, i);
+        $trace ("\t%s", block->mnemonic[i]);
         continue;
       }
-      
-      if ((op_1->type == X86_OP_REG) && (op_2->type == X86_OP_MEM))
+
+      if ((op_1->type == CFG_IR_OP_REG) && (op_2->type == CFG_IR_OP_MEM))
       {
-        if (!array$contains_rval (tracked_regs, op_1->reg))
+        auto dst_bit = cfg_sim$x86$get_reg_bit (op_1->reg);
+        if (!(state->tracked_regs & dst_bit))
         {
           $trace_debug ("NO TRACKED REGS");
           continue;
         }
-        array$remove_rval (tracked_regs, op_1->reg);
-        if (op_2->mem.base != X86_REG_RIP)
+        state->tracked_regs &= ~dst_bit;
+        cfg_memloc_t loc;
+        if ((op_2->mem.base != X86_REG_RIP)
+            && cfg_ir$get_memloc (block, i, 1, &loc))
         {
-          array$append (tracked_mem, &op_2->mem);
+          $trace_debug ("tracking memory location: %" PRIx64, loc);
+          map$set (state->tracked_mem, loc, (void *)1);
           if (op_2->mem.base != X86_REG_RSP)
-          {
-            array$append_rval (tracked_regs, op_2->mem.base);
-          }
+            state->tracked_regs |= cfg_sim$x86$get_reg_bit (op_2->mem.base);
         }
-        array$insert (df_insns, 0, insn);
-        $trace ("\t%s %s", insn->mnemonic, insn->op_str);
+        cfg_ir$append_row (state->df_insns, block, i);
+        $trace ("\t%s", block->mnemonic[i]);
         continue;
       }
     }
 
-    for (size_t i_wreg = 0; i_wreg < regs_write_count; ++i_wreg)
+    /* if we're writing to a tracked register, then we can stop tracking it,
+     * and track whatever it was computed from instead
+     */
+    if (!(block->regs_written[i] & state->tracked_regs))
     {
-      /* if we're writing to a tracked register, then we can stop tracking it */
-      auto wreg = regs_write[i_wreg];
-      if (!array$contains_rval (tracked_regs, wreg))
-      {
-        $trace_debug ("NO TRACKED REGS");
-        continue;
-      }
-      $trace_debug (
-        "no longer tracking register: %s", cs_reg_name (ctx->handle, wreg));
-      array$remove_rval (tracked_regs, wreg);
-      for (size_t i_rreg = 0; i_rreg < regs_read_count; ++i_rreg)
-      {
-        auto rreg = regs_read[i_rreg];
-        $trace_debug ("tracking register: %s", cs_reg_name (ctx->handle, rreg));
-        array$append_rval (tracked_regs, rreg);
-      }
-      array$insert (df_insns, 0, insn);
-      $trace ("\t%s %s", insn->mnemonic, insn->op_str);
-    }
-
-  }
-  cs_free (insns, insn_count);
-
-  if (!array$is_empty (tracked_regs))
-  {
-    auto preds = cfg$get_preds (ctx->cfg, ctx->fn_tag, basic_tag);
-    if (array$is_empty (preds))
-      $trace ("NO PREDECESSOR BLOCKS...");
-    $array_for_each ($, preds, vertex_tag_t, pred)
-    {
-      trace_reg_block_dataflow (
-        ctx, *$.pred, NULL, depth + 1, df_insns, tracked_regs, tracked_mem,
-        visited_blocks);
+      $trace_debug ("NO TRACKED REGS");
+      continue;
     }
-    array$free (preds);
+    state->tracked_regs &= ~block->regs_written[i];
+    state->tracked_regs |= block->regs_read[i] & ~untracked_regs;
+    cfg_ir$append_row (state->df_insns, block, i);
+    $trace ("\t%s", block->mnemonic[i]);
   }
 }
 
 static void
-df_insn_free (void* ptr)
+queue_preds (
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, array_t worklist,
+  struct df_slice_item* item)
 {
-  array_t array = ptr;
-  $array_for_each ($, array, struct cs_insn, insn)
+  auto preds = cfg$get_preds (ctx->cfg, fn_tag, item->basic_tag);
+  if (array$is_empty (preds))
+    $trace ("NO PREDECESSOR BLOCKS...");
+  /* NB: pushed in reverse, so predecessors are popped in order */
+  for (ssize_t i = array$length (preds) - 1; i >= 0; --i)
   {
-    $chk_free ($.insn->detail);
+    struct df_slice_item pred = {
+      .basic_tag = *(vertex_tag_t *)array$at (preds, i),
+      .depth = item->depth + 1
+    };
+    array$append (worklist, &pred);
   }
 }
 
-static void*
-cs_insn_memmove (
-  void* dst, const void* src, size_t n)
-{
-  const cs_insn* src_insn = src;
-  auto src_detail = src_insn->detail;
-  cs_insn* dst_insn = memmove (dst, src_insn, n);
-  if (src_detail != NULL)
-  {
-    dst_insn->detail = $chk_allocty (struct cs_detail*);
-    memmove (dst_insn->detail, src_detail, sizeof (struct cs_detail));
-  }
-  return dst_insn;
-}
-
-static void*
-cs_insn_memcpy (
-  void* restrict dst, const void* restrict src, size_t n)
-{
-  const cs_insn* src_insn = src; 
-  cs_insn* dst_insn = memcpy (dst, src_insn, n);
-  if (src_insn->detail != NULL)
-  {
-    dst_insn->detail = $chk_allocty (struct cs_detail*);
-    memcpy (dst_insn->detail, src_insn->detail, sizeof (struct cs_detail));
-  }
-  return dst_insn;
-}
-
-static array_t /* struct cs_insn (copy) */
+static cfg_ir_t
 trace_reg_dataflow (
-  cfg_gen_ctx_t ctx, vertex_tag_t basic_tag, enum x86_reg* dep_regs,
-   size_t dep_regs_count, uint64_t address)
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, vertex_tag_t basic_tag,
+  const enum x86_reg* dep_regs, size_t dep_regs_count, uint64_t address)
 {
-  size_t insn_count;
-  auto insns = read_insns_at_block_before (
-    ctx, &insn_count, basic_tag, address);
-  auto df_insns = array$new (sizeof (struct cs_insn));
-  array$set_copy_hooks (df_insns, cs_insn_memcpy, cs_insn_memmove);
-  array$set_free_hook (df_insns, df_insn_free);
+  /* the first block is only sliced up to `address`, and is the only item of
+   * depth 0
+   */
+  auto insns = read_insns_at_block_before (ctx, fn_tag, basic_tag, address);
+  if (insns == NULL)
+    return NULL;
 
-  array_t tracked_regs = array$new (sizeof (enum x86_reg)),
-          tracked_mem = array$new (sizeof (struct x86_op_mem));
+  struct df_slice_state state = {
+    .tracked_mem = map$new (),
+    .block_insns = cfg_ir$new (),
+    .df_insns = cfg_ir$new (),
+  };
   for (size_t i = 0; i < dep_regs_count; ++i)
-    array$append_rval (tracked_regs, dep_regs[i]);
+    state.tracked_regs |= cfg_sim$x86$get_reg_bit (dep_regs[i]);
+
+  /* blocks are visited at most once per slice, by their dense slot */
+  auto visited_blocks = bitmap$new (
+    cfg$get_basic_block_count (ctx->cfg, fn_tag));
+  auto worklist = array$new (sizeof (struct df_slice_item));
+  array$append (worklist, &(struct df_slice_item){.basic_tag = basic_tag});
 
-  array_t visited_blocks = array$new (sizeof (vertex_tag_t));
   $trace ("BEGIN TRACING");
-  trace_reg_block_dataflow (
-    ctx, basic_tag, insns, insn_count, df_insns, tracked_regs, tracked_mem,
-    visited_blocks);
+  while (!array$is_empty (worklist))
+  {
+    struct df_slice_item item;
+    array$pop (worklist, &item, array$length (worklist) - 1);
+
+    auto slot = cfg$get_basic_block_slot (
+      ctx->cfg, fn_tag, item.basic_tag);
+    if (bitmap$test (visited_blocks, slot))
+    {
+      $trace ("ALREADY VISITED BLOCK: %" PRIx64, item.basic_tag);
+      continue;
+    }
+    if (item.depth > ctx->max_df_depth)
+    {
+      $trace_err ("exceeded maximum dataflow analysis depth");
+      continue;
+    }
+    bitmap$set (visited_blocks, slot);
+
+    const struct cfg_block_summary* summary = NULL;
+    if (item.depth)
+    {
+      summary = cfg$get_basic_block_summary (
+        ctx->cfg, fn_tag, item.basic_tag);
+      if ((summary != NULL)
+          && !(summary->regs_defined & state.tracked_regs)
+          && !is_store_relevant (&state, summary))
+      {
+        $trace ("BLOCK DEFINES NOTHING TRACKED: %" PRIx64, item.basic_tag);
+        if (state.tracked_regs)
+          queue_preds (ctx, fn_tag, worklist, &item);
+        continue;
+      }
+      insns = read_insns_at_block (ctx, fn_tag, item.basic_tag);
+      if (insns == NULL)
+        continue;
+    }
+
+    lower_block (ctx, state.block_insns, insns);
+    array$free (insns);
+    if (item.depth && (summary == NULL))
+      summary = summarize_block (
+        ctx, fn_tag, item.basic_tag, state.block_insns);
+
+    slice_block (&state, item.basic_tag, summary);
+    if (state.tracked_regs)
+      queue_preds (ctx, fn_tag, worklist, &item);
+  }
   $trace ("FINISH TRACE.");
+  cfg_ir$reverse (state.df_insns);
 
-  array$free (visited_blocks);
-  array$free (tracked_regs);
-  array$free (tracked_mem);
-  return df_insns;
+  array$free (worklist);
+  bitmap$free (visited_blocks);
+  map$free (state.tracked_mem);
+  cfg_ir$free (state.block_insns);
+  return state.df_insns;
 }
 
-static array_t /* struct cs_insn */
+static cfg_ir_t
 trace_flag_dataflow (
-  cfg_gen_ctx_t ctx, vertex_tag_t block_tag, cs_insn* branch_insn)
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, vertex_tag_t block_tag,
+  const cs_insn* branch_insn)
 {
-  size_t insn_count;
   auto insns = read_insns_at_block_before (
-    ctx, &insn_count, block_tag, branch_insn->address);
-  auto branch_tested = get_insn_tested_flags (branch_insn);
+    ctx, fn_tag, block_tag, branch_insn->address);
+  if (insns == NULL)
+    return NULL;
+  auto branch_tested = cfg_ir$get_tested_flags (branch_insn);
 
-  cs_insn* cmp_insn = NULL;
-  for (ssize_t i = insn_count - 1; i >= 0; --i)
+  const cs_insn* cmp_insn = NULL;
+  for (ssize_t i = array$length (insns) - 1; i >= 0; --i)
   {
-    auto insn = &insns[i];
-    auto insn_modified = get_insn_modified_flags (insn);
+    auto insn = slice_at (insns, i);
+    auto insn_modified = cfg_ir$get_modified_flags (insn);
 
     $trace_debug (
       "%s %s (modifies: %" PRIx64 ")",
@@ -431,38 +494,35 @@ trace_flag_dataflow (
     $trace (
       "couldn't find insn. matching flag criteria for %s",
       branch_insn->mnemonic);
-    cs_free (insns, insn_count);
+    array$free (insns);
     return NULL;
   }
 
   enum x86_reg dep_reg = X86_REG_EFLAGS;
   auto cmp_insn_addr = cmp_insn->address + cmp_insn->size;
-  cs_free (insns, insn_count);
+  array$free (insns);
 
-  return trace_reg_dataflow (ctx, block_tag, &dep_reg, 1, cmp_insn_addr);
+  return trace_reg_dataflow (
+    ctx, fn_tag, block_tag, &dep_reg, 1, cmp_insn_addr);
 }
 
-static cs_insn*
-find_next_branch (cfg_gen_ctx_t ctx, cs_insn** ptrinsns, size_t insn_count)
+static const cs_insn*
+find_next_branch (cfg_gen_ctx_t ctx, uint64_t address)
 {
-  auto insns = *ptrinsns;
-  for (size_t j = 0; j < 3; ++j)
+  auto max_address
+    = address + MAX_BRANCH_SEARCH_PAGES * pe$get_pagesize (ctx->pe);
+  for (auto insn = cfg_decode$insn_at (ctx->decode_cache, address);
+       insn != NULL && insn->address < max_address;
+       insn = cfg_decode$next (ctx->decode_cache, insn))
   {
-    uint64_t last_address;
-    for (size_t i = 0; i < insn_count; ++i)
-    {
-      auto insn = &insns[i];
-      $trace (
-        "%" PRIx64 ": %s\t%s", insn->address, insn->mnemonic, insn->op_str);
-      if (cs_insn_group (ctx->handle, insn, X86_GRP_JUMP)
-          || cs_insn_group (ctx->handle, insn, X86_GRP_CALL)
-          || cs_insn_group (ctx->handle, insn, X86_GRP_RET))
-        return insn;
-      last_address = insn->address;
-    }
-    cs_free (insns, insn_count);
-    insns = read_insns_at (ctx, &insn_count, last_address);
-    *ptrinsns = insns;
+    $trace_debug (
+      "%" PRIx64 ": %s\t%s", insn->address, insn->mnemonic, insn->op_str);
+    if (cfg_decode$get_branch_kind (insn) == CFG_BRANCH_NONE)
+      continue;
+    auto branch = cfg_decode$detail (ctx->decode_cache, insn);
+    if (branch == NULL)
+      break;
+    return branch;
   }
   $abort (
     "failed to find branch in several pages, maybe we are disassembling "
@@ -470,15 +530,29 @@ find_next_branch (cfg_gen_ctx_t ctx, cs_insn** ptrinsns, size_t insn_count)
 }
 
 static bool
-determine_sp_offset (cfg_gen_ctx_t ctx, uint64_t* sp_offset)
+determine_sp_offset (
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, uint64_t* sp_offset)
 {
-  size_t insn_count;
-  auto entry_insns = read_insns_at_block(
-    ctx, &insn_count, cfg$get_entry_block (ctx->cfg, ctx->fn_tag));
+  auto entry_tag = cfg$get_entry_block (ctx->cfg, fn_tag);
+  auto fn_rva = cfg$get_basic_block_rva (ctx->cfg, fn_tag, entry_tag);
+  /* the unwind info already describes the prologue, if the function has any */
+  auto runtime_function = pe$find_runtime_function (ctx->pe, fn_rva);
+  if ((runtime_function != NULL)
+      && (runtime_function->begin_address == fn_rva)
+      && pe$get_unwind_alloc_size (ctx->pe, runtime_function, sp_offset))
+  {
+    $trace ("unwound sp-offset for function: -%" PRIx64, *sp_offset);
+    return true;
+  }
 
-  for (size_t i = 0; i < insn_count; ++i)
+  auto entry_insns = read_insns_at_block (ctx, fn_tag, entry_tag);
+  if (entry_insns == NULL)
+    return false;
+
+  bool found = false;
+  $array_for_each ($, entry_insns, const cs_insn*, ptrinsn)
   {
-    auto insn = &entry_insns[i];
+    auto insn = *$.ptrinsn;
     auto operands = insn->detail->x86.operands;
     if ((insn->id != X86_INS_SUB) || (operands[0].type != X86_OP_REG))
       continue;
@@ -497,19 +571,40 @@ determine_sp_offset (cfg_gen_ctx_t ctx, uint64_t* sp_offset)
       case X86_OP_IMM:
         *sp_offset = operands[1].imm;
         $trace ("determined sp-offset for function: -%" PRIx64, *sp_offset);
-        return true;
+        found = true;
+        break;
       default:
         $trace_err ("indeterminate sp-offset for function block");
-        return false;
+        break;
     }
+    break;
   }
 
-  return false;
+  array$free (entry_insns);
+  return found;
+}
+
+static void
+queue_item (cfg_gen_ctx_t ctx, struct cfg_gen_item item)
+{
+  array$append (ctx->worklist, &item);
+}
+
+static void
+queue_callee (cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, uint64_t address)
+{
+  struct cfg_gen_item item = {
+    .kind = CFG_GEN_ITEM_FUNCTION,
+    .pred = fn_tag,
+    .address = address,
+  };
+  array$append (ctx->defer_callees ? ctx->deferred : ctx->worklist, &item);
 }
 
 static bool
 dispatch_jump_imm (
-  cfg_gen_ctx_t ctx, cs_insn* branch_insn, vertex_tag_t pred)
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, const cs_insn* branch_insn,
+  vertex_tag_t pred)
 {
   int64_t jmp_targets[] = {
     branch_insn->detail->x86.operands[0].imm,  /* true branch */
@@ -518,21 +613,22 @@ dispatch_jump_imm (
 
   if (branch_insn->id != X86_INS_JMP)
   { /* is conditional jump? if so, check if reducible */
-    auto df_flags = trace_flag_dataflow (ctx, pred, branch_insn);
+    auto df_flags = trace_flag_dataflow (ctx, fn_tag, pred, branch_insn);
 
     jmp_targets[1] = branch_insn->address + branch_insn->size;
-    if ((df_flags == NULL) || array$is_empty (df_flags))
+    if ((df_flags == NULL) || cfg_ir$is_empty (df_flags))
     {
       $trace ("branch is indeterminate, continuing...");
       if (df_flags != NULL)
-        array$free (df_flags);
+        cfg_ir$free (df_flags);
       goto failed_df;
     }
-    $trace ("found %zu flag dataflow instructions", array$length (df_flags));
+    $trace ("found %zu flag dataflow instructions", cfg_ir$length (df_flags));
 
-    if (cfg_sim$simulate_insns (ctx->sim, ctx->fn_tag, df_flags))
+    if (cfg_sim$simulate_insns (ctx->sim, fn_tag, df_flags))
     {
-      auto sim_eflags = ctx->sim->fn.get_flags (ctx->sim->state);
+      auto sim_eflags = ctx->sim->fn.get_flags (
+        ctx->sim->state, cfg_ir$get_tested_flags (branch_insn));
       if (!branch_would_take (branch_insn, sim_eflags))
       {  /* branch is never taken */
         $trace (
@@ -546,162 +642,229 @@ dispatch_jump_imm (
           jmp_targets[0]);
       jmp_targets[1] = 0;
     }
-    array$free (df_flags);
+    cfg_ir$free (df_flags);
   }
 
 failed_df:
-  for (size_t i = 0; i < sizeof (jmp_targets) / sizeof (*jmp_targets); ++i)
+  /* NB: queued in reverse, so the true branch is explored first */
+  for (ssize_t i = $arraysize (jmp_targets) - 1; i >= 0; --i)
   {
     auto jmp_target = jmp_targets[i];
     if (i && !jmp_target)
-      break;
+      continue;
 
     $trace (
       "%" PRIx64 ": JUMP (%s) -> %" PRIx64,
       branch_insn->address, branch_insn->mnemonic, jmp_target);
-
-    if (cfg$is_address_visited (ctx->cfg, jmp_target))
-    { /* is back-reference to earlier block? */
-      auto visited_block = cfg$get_basic_block (
-        ctx->cfg, ctx->fn_tag, jmp_target);
-      auto jmp_block = cfg$split_basic_block (
-        ctx->cfg, ctx->fn_tag, visited_block, jmp_target);
-      cfg$connect_basic_blocks (ctx->cfg, ctx->fn_tag, pred, jmp_block);
-      continue;
-    }
-
-    size_t insn_count;
-    auto insns = read_insns_at (ctx, &insn_count, jmp_target);
-    auto next_branch = find_next_branch (ctx, &insns, insn_count);
-
-    auto new_tag = cfg$add_basic_block_succ (
-      ctx->cfg, ctx->fn_tag, pred, jmp_target);
-    cfg$set_basic_block_end (
-      ctx->cfg, ctx->fn_tag, new_tag, next_branch->address + next_branch->size);
-
-    if (!cfg_gen$recurse_branch_insns (ctx, next_branch, new_tag))
-      return false;
-    cs_free (insns, insn_count);
+    queue_item (ctx, (struct cfg_gen_item){
+      .kind = CFG_GEN_ITEM_BLOCK,
+      .fn_tag = fn_tag,
+      .pred = pred,
+      .address = jmp_target,
+    });
   }
   return true;
 }
 
-bool
-cfg_gen$recurse_branch_insns (
-  cfg_gen_ctx_t ctx, cs_insn* branch_insn, vertex_tag_t pred)
+static bool
+dispatch_branch_insn (
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_tag, const cs_insn* branch_insn,
+  vertex_tag_t pred)
 {
   auto operands = branch_insn->detail->x86.operands;
-  if (cs_insn_group (ctx->handle, branch_insn, X86_GRP_JUMP))
-  {
-    switch (operands[0].type)
-    {
-      case X86_OP_IMM:
-        return dispatch_jump_imm (ctx, branch_insn, pred); 
-      case X86_OP_REG:
-      case X86_OP_MEM:
-      case X86_OP_INVALID:
-        $abort ("unimplemented jump type");
-        break;
-    }
-  }
-  else if (cs_insn_group (ctx->handle, branch_insn, X86_GRP_CALL))
+  /* NB: the same classifier that ended the block decides how it's left, so
+   *     the two can't disagree whatever groups capstone assigns
+   */
+  switch (cfg_decode$get_branch_kind (branch_insn))
   {
-    switch (operands[0].type)
-    {
-      case X86_OP_IMM:
-        return cfg_gen$recurse_function_block (
-          ctx, ctx->fn_tag, operands[0].imm);
-
-      case X86_OP_MEM:
+    case CFG_BRANCH_JUMP:
+      switch (operands[0].type)
       {
-        auto operand = branch_insn->detail->x86.operands[0];
-        if (operand.mem.base != X86_REG_RIP)
-          $abort ("unimplemented call to %s", branch_insn->op_str);
-        auto iat_addr
-          = branch_insn->address + branch_insn->size + operand.mem.disp;
-        $trace ("jump to IAT entry at %" PRIx64, iat_addr);
-        /* TODO: validate `iat_addr` actually in IAT bounds */
-        return false;
+        case X86_OP_IMM:
+          return dispatch_jump_imm (ctx, fn_tag, branch_insn, pred);
+        case X86_OP_REG:
+        case X86_OP_MEM:
+        case X86_OP_INVALID:
+          $abort ("unimplemented jump type");
+          break;
       }
+      break;
 
-      case X86_OP_REG:
+    case CFG_BRANCH_CALL:
+      switch (operands[0].type)
       {
-        auto df_insns = trace_reg_dataflow (
-          ctx, pred, &branch_insn->detail->x86.operands[0].reg, 1,
-          branch_insn->address);
-        if (df_insns == NULL)
+        case X86_OP_IMM:
+          queue_callee (ctx, fn_tag, operands[0].imm);
+          return true;
+
+        case X86_OP_MEM:
         {
-          $trace ("failed to simulate dataflow, possibly indeterminate");
+          auto operand = branch_insn->detail->x86.operands[0];
+          if (operand.mem.base != X86_REG_RIP)
+            $abort ("unimplemented call to %s", branch_insn->op_str);
+          auto iat_addr
+            = branch_insn->address + branch_insn->size + operand.mem.disp;
+          $trace ("jump to IAT entry at %" PRIx64, iat_addr);
+          /* TODO: validate `iat_addr` actually in IAT bounds */
           return false;
         }
 
-        $trace (
-          "found %zu register dataflow instructions", array$length (df_insns));
-
-        auto success = cfg_sim$simulate_insns (ctx->sim, ctx->fn_tag, df_insns);
-        if (!success || array$is_empty (df_insns))
+        case X86_OP_REG:
         {
-          $trace ("failed to simulate dataflow, possibly indeterminate");
-          array$free (df_insns);
-          return false;
-        }
-        array$free (df_insns);
+          auto df_insns = trace_reg_dataflow (
+            ctx, fn_tag, pred, &branch_insn->detail->x86.operands[0].reg, 1,
+            branch_insn->address);
+          if (df_insns == NULL)
+          {
+            $trace ("failed to simulate dataflow, possibly indeterminate");
+            return false;
+          }
 
-        uint64_t reg_mask;
-        auto reg_val = ctx->sim->fn.get_reg (
-          ctx->sim->state, &reg_mask, operands[0].reg);
-        $trace (
-          "simulated %s value: %" PRIx64,
-          branch_insn->op_str, *reg_val & reg_mask);
+          $trace (
+            "found %zu register dataflow instructions",
+            cfg_ir$length (df_insns));
+
+          auto success = cfg_sim$simulate_insns (ctx->sim, fn_tag, df_insns);
+          if (!success || cfg_ir$is_empty (df_insns))
+          {
+            $trace ("failed to simulate dataflow, possibly indeterminate");
+            cfg_ir$free (df_insns);
+            return false;
+          }
+          cfg_ir$free (df_insns);
 
-        return cfg_gen$recurse_function_block (
-          ctx, ctx->fn_tag, *reg_val & reg_mask);
+          uint64_t reg_val;
+          if (!ctx->sim->fn.get_reg (
+              ctx->sim->state, NULL, operands[0].reg, &reg_val))
+          {
+            $trace ("simulated %s is indeterminate", branch_insn->op_str);
+            return false;
+          }
+          $trace (
+            "simulated %s value: %" PRIx64, branch_insn->op_str, reg_val);
+
+          queue_callee (ctx, fn_tag, reg_val);
+          return true;
+        }
+
+        case X86_OP_INVALID:
+          $abort ("invalid call operand type");
+          break;
       }
+      break;
 
-      case X86_OP_INVALID:
-        $abort ("invalid call operand type");
-        break;
-    }
-  }
-  else if (cs_insn_group (ctx->handle, branch_insn, X86_GRP_RET))
-  {
-    $abort ("unimplemented ret insn.");
+    case CFG_BRANCH_RET:
+      $abort ("unimplemented ret insn.");
+      break;
+
+    case CFG_BRANCH_NONE:
+      break;
   }
-  __builtin_unreachable ();
+  $abort (
+    "unexpected branch insn. at %" PRIx64 ": %s %s", branch_insn->address,
+    branch_insn->mnemonic, branch_insn->op_str);
 }
 
-bool
-cfg_gen$recurse_function_block (
-  cfg_gen_ctx_t ctx, vertex_tag_t fn_pred, uint64_t block_address)
+static bool
+generate_function_block (cfg_gen_ctx_t ctx, const struct cfg_gen_item* item)
 {
-  if (cfg$is_address_visited (ctx->cfg, block_address))
-    return true;
   vertex_tag_t fn_tag;
-  if (fn_pred)
-    fn_tag = cfg$add_function_block_succ (ctx->cfg, fn_pred, block_address);
+  if (item->pred)
+    fn_tag = cfg$add_function_block_succ (ctx->cfg, item->pred, item->address);
   else
-    fn_tag = cfg$add_function_block (ctx->cfg, block_address);
-  ctx->fn_tag = fn_tag;
-  auto entry_tag = cfg$add_basic_block (ctx->cfg, ctx->fn_tag, block_address);
+    fn_tag = cfg$add_function_block (ctx->cfg, item->address);
+  /* already claimed, possibly by another generator */
+  if (!fn_tag)
+    return true;
+  auto entry_tag = cfg$add_basic_block (ctx->cfg, fn_tag, item->address);
 
-  size_t insn_count;
-  cs_insn *insns = read_insns_at (ctx, &insn_count, block_address);
-  cs_insn *branch_insn = find_next_branch (ctx, &insns, insn_count);
+  auto branch_insn = find_next_branch (ctx, item->address);
   cfg$set_basic_block_end (
     ctx->cfg, fn_tag, entry_tag,
     branch_insn->address + branch_insn->size);
   $trace (
     "new function block (size %" PRIu64" bytes): %" PRIx64,
-    cfg$get_basic_block_size (ctx->cfg, ctx->fn_tag, entry_tag), ctx->fn_tag);
+    cfg$get_basic_block_size (ctx->cfg, fn_tag, entry_tag), fn_tag);
 
   uint64_t sp_offset;
-  if (!determine_sp_offset (ctx, &sp_offset))
+  if (!determine_sp_offset (ctx, fn_tag, &sp_offset))
     $trace_err ("couldn't find function block sp-offset");
   else
     cfg$set_function_block_sp_offset (ctx->cfg, fn_tag, sp_offset);
 
-  auto success = cfg_gen$recurse_branch_insns (ctx, branch_insn, entry_tag);
-  cs_free (insns, insn_count);
+  return dispatch_branch_insn (ctx, fn_tag, branch_insn, entry_tag);
+}
+
+static bool
+generate_basic_block (cfg_gen_ctx_t ctx, const struct cfg_gen_item* item)
+{
+  auto fn_tag = item->fn_tag;
+  /* NB: only blocks of this function count, the address may also be part of
+   *     another function, which could be being generated concurrently
+   */
+  auto visited_block = cfg$get_basic_block (ctx->cfg, fn_tag, item->address);
+  if (visited_block)
+  { /* is back-reference to earlier block? */
+    auto jmp_block = cfg$split_basic_block (
+      ctx->cfg, fn_tag, visited_block, item->address);
+    cfg$connect_basic_blocks (ctx->cfg, fn_tag, item->pred, jmp_block);
+    return true;
+  }
+
+  auto next_branch = find_next_branch (ctx, item->address);
+
+  auto new_tag = cfg$add_basic_block_succ (
+    ctx->cfg, fn_tag, item->pred, item->address);
+  cfg$set_basic_block_end (
+    ctx->cfg, fn_tag, new_tag, next_branch->address + next_branch->size);
+
+  return dispatch_branch_insn (ctx, fn_tag, next_branch, new_tag);
+}
+
+void
+cfg_gen$queue_function_block (
+  cfg_gen_ctx_t ctx, vertex_tag_t fn_pred, uint64_t block_address)
+{
+  queue_item (ctx, (struct cfg_gen_item){
+    .kind = CFG_GEN_ITEM_FUNCTION,
+    .pred = fn_pred,
+    .address = block_address,
+  });
+}
+
+bool
+cfg_gen$generate (cfg_gen_ctx_t ctx)
+{
+  bool success = true;
+  /* NB: the worklist is a stack, so blocks are still explored depth-first,
+   *     in the same order the generator used to recurse in
+   */
+  while (!array$is_empty (ctx->worklist))
+  {
+    struct cfg_gen_item item;
+    array$pop (ctx->worklist, &item, array$length (ctx->worklist) - 1);
+
+    bool item_success;
+    switch (item.kind)
+    {
+      case CFG_GEN_ITEM_FUNCTION:
+        item_success = generate_function_block (ctx, &item);
+        break;
+      case CFG_GEN_ITEM_BLOCK:
+        item_success = generate_basic_block (ctx, &item);
+        break;
+      default:
+        $abort ("invalid cfg. generator work item (%d)", item.kind);
+    }
+
+    if (!item_success)
+    {
+      $trace_err (
+        "failed to generate block at %" PRIx64 ", continuing...",
+        item.address);
+      success = false;
+    }
+  }
   return success;
 }
 
@@ -709,16 +872,55 @@ void
 cfg_gen$free_context (cfg_gen_ctx_t ctx)
 {
   cfg_sim$free (ctx->sim);
+  cfg_decode$free (ctx->decode_cache);
+  array$free (ctx->worklist);
+  array$free (ctx->deferred);
   $chk_free (ctx);
 }
 
 cfg_gen_ctx_t
-cfg_gen$new_context (pe_context_t pe_context, cfg_t cfg, csh handle)
+cfg_gen$new_context (
+  pe_context_t pe_context, cfg_t cfg, csh scan_handle, csh handle)
 {
   auto ctx = $chk_allocty (cfg_gen_ctx_t);
   ctx->pe = pe_context;
   ctx->cfg = cfg;
   ctx->handle = handle;
+  ctx->max_df_depth = MAX_DF_BLOCK_DEPTH;
+  ctx->decode_cache = cfg_decode$new (pe_context, scan_handle, handle);
   ctx->sim = cfg_sim$new_context (cfg, CS_ARCH_X86);
+  ctx->worklist = array$new (sizeof (struct cfg_gen_item));
+  ctx->deferred = array$new (sizeof (struct cfg_gen_item));
   return ctx;
+}
+
+void
+cfg_gen$set_defer_callees (cfg_gen_ctx_t ctx, bool defer)
+{
+  ctx->defer_callees = defer;
+}
+
+bool
+cfg_gen$pop_deferred_callee (
+  cfg_gen_ctx_t ctx, vertex_tag_t* fn_pred, uint64_t* address)
+{
+  if (array$is_empty (ctx->deferred))
+    return false;
+  struct cfg_gen_item item;
+  array$pop (ctx->deferred, &item, array$length (ctx->deferred) - 1);
+  *fn_pred = item.pred;
+  *address = item.address;
+  return true;
+}
+
+void
+cfg_gen$set_max_df_depth (cfg_gen_ctx_t ctx, size_t depth)
+{
+  ctx->max_df_depth = depth;
+}
+
+struct cfg_decode_stats
+cfg_gen$get_decode_stats (cfg_gen_ctx_t ctx)
+{
+  return cfg_decode$get_stats (ctx->decode_cache);
 }
\ No newline at end of file
@@ -0,0 +1,284 @@
+#include <capstone/capstone.h>
+#include <string.h>
+
+#include "cfg/cfg-ir.h"
+#include "cfg/cfg-sim.h"
+#include "cfg/arch/x86.h"
+
+#define CFG_IR_INITIAL_CAPACITY (16)
+
+#define MEMLOC_KIND_SHIFT (62)
+#define MEMLOC_REG_BITS   (8)
+#define MEMLOC_RVA_MASK   ((1ull << MEMLOC_KIND_SHIFT) - 1)
+
+/* applies `fn` to the name of every column */
+#define $for_each_column(fn) \
+  fn (address); \
+  fn (id); \
+  fn (size); \
+  fn (op_count); \
+  fn (operands); \
+  fn (regs_read); \
+  fn (regs_written); \
+  fn (flags_tested); \
+  fn (flags_modified); \
+  fn (mnemonic);
+
+static void
+reserve_row (cfg_ir_t ir)
+{
+  if (ir->length < ir->capacity)
+    return;
+
+  ir->capacity = ir->capacity
+    ? ir->capacity * 2
+    : CFG_IR_INITIAL_CAPACITY;
+#define $grow_column(column) \
+  ir->column = $chk_reallocarray ( \
+    ir->column, sizeof (*ir->column), ir->capacity)
+  $for_each_column ($grow_column)
+#undef $grow_column
+}
+
+cfg_ir_t
+cfg_ir$new (void)
+{
+  return $chk_allocty (cfg_ir_t);
+}
+
+void
+cfg_ir$free (cfg_ir_t ir)
+{
+#define $free_column(column) $chk_free (ir->column)
+  $for_each_column ($free_column)
+#undef $free_column
+  $chk_free (ir);
+}
+
+size_t
+cfg_ir$length (cfg_ir_t ir)
+{
+  return ir->length;
+}
+
+bool
+cfg_ir$is_empty (cfg_ir_t ir)
+{
+  return !ir->length;
+}
+
+void
+cfg_ir$clear (cfg_ir_t ir)
+{
+  ir->length = 0;
+}
+
+uint64_t
+cfg_ir$get_modified_flags (const cs_insn* insn)
+{
+  auto eflags = insn->detail->x86.eflags;
+  uint64_t ret = 0;
+
+#define $check_modify(flag) \
+  if (eflags & (X86_EFLAGS_MODIFY_##flag | X86_EFLAGS_SET_##flag)) \
+    ret |= EFLAGS_##flag;
+
+  $check_modify(OF);
+  $check_modify(SF);
+  $check_modify(ZF);
+  $check_modify(PF);
+  $check_modify(CF);
+  $check_modify(AF);
+  $check_modify(DF);
+  $check_modify(IF);
+
+#undef $check_modify
+  return ret;
+}
+
+uint64_t
+cfg_ir$get_tested_flags (const cs_insn* insn)
+{
+  auto eflags = insn->detail->x86.eflags;
+  uint64_t ret = 0;
+
+  if (eflags & X86_EFLAGS_TEST_OF) ret |= EFLAGS_OF;
+  if (eflags & X86_EFLAGS_TEST_SF) ret |= EFLAGS_SF;
+  if (eflags & X86_EFLAGS_TEST_ZF) ret |= EFLAGS_ZF;
+  if (eflags & X86_EFLAGS_TEST_PF) ret |= EFLAGS_PF;
+  if (eflags & X86_EFLAGS_TEST_CF) ret |= EFLAGS_CF;
+  if (eflags & X86_EFLAGS_TEST_AF) ret |= EFLAGS_AF;
+  if (eflags & X86_EFLAGS_TEST_TF) ret |= EFLAGS_TF;
+
+  return ret;
+}
+
+static struct cfg_ir_operand
+lower_operand (const cs_x86_op* op)
+{
+  struct cfg_ir_operand ret = {.size = op->size};
+  switch (op->type)
+  {
+    case X86_OP_REG:
+      ret.type = CFG_IR_OP_REG;
+      ret.reg = op->reg;
+      break;
+    case X86_OP_IMM:
+      ret.type = CFG_IR_OP_IMM;
+      ret.imm = op->imm;
+      break;
+    case X86_OP_MEM:
+      ret.type = CFG_IR_OP_MEM;
+      ret.mem = (struct cfg_ir_mem){
+        .segment = op->mem.segment,
+        .base = op->mem.base,
+        .index = op->mem.index,
+        .scale = op->mem.scale,
+        .disp = op->mem.disp,
+      };
+      break;
+    default:
+      ret.type = CFG_IR_OP_INVALID;
+      break;
+  }
+  return ret;
+}
+
+static uint64_t
+get_reg_bits (const uint16_t* regs, uint8_t count)
+{
+  uint64_t ret = 0;
+  for (uint8_t i = 0; i < count; ++i)
+    ret |= cfg_sim$x86$get_reg_bit (regs[i]);
+  return ret;
+}
+
+bool
+cfg_ir$append_insn (cfg_ir_t ir, csh handle, const cs_insn* insn)
+{
+  $strict_assert (insn->detail != NULL, "Instruction has no detail");
+
+  uint8_t regs_write_count, regs_read_count;
+  cs_regs regs_write, regs_read;
+  if (cs_regs_access (
+      handle, insn, regs_read, &regs_read_count, regs_write,
+      &regs_write_count) != CS_ERR_OK)
+  {
+    $trace_err ("cs_regs_access failed");
+    return false;
+  }
+
+  reserve_row (ir);
+  auto row = ir->length++;
+  auto x86 = &insn->detail->x86;
+
+  ir->address[row] = insn->address;
+  ir->id[row] = insn->id;
+  ir->size[row] = insn->size;
+  ir->op_count[row] = x86->op_count;
+  memset (ir->operands[row], 0, sizeof (*ir->operands));
+  for (uint8_t i = 0; i < $min (x86->op_count, CFG_IR_MAX_OPERANDS); ++i)
+    ir->operands[row][i] = lower_operand (&x86->operands[i]);
+  ir->regs_read[row] = get_reg_bits (regs_read, regs_read_count);
+  ir->regs_written[row] = get_reg_bits (regs_write, regs_write_count);
+  ir->flags_tested[row] = cfg_ir$get_tested_flags (insn);
+  ir->flags_modified[row] = cfg_ir$get_modified_flags (insn);
+  ir->mnemonic[row] = insn->mnemonic;
+  return true;
+}
+
+void
+cfg_ir$append_row (cfg_ir_t ir, cfg_ir_t src, size_t idx)
+{
+  $strict_assert (idx < src->length, "Row index out of bounds");
+  reserve_row (ir);
+  auto row = ir->length++;
+#define $copy_column(column) \
+  memcpy (&ir->column[row], &src->column[idx], sizeof (*ir->column))
+  $for_each_column ($copy_column)
+#undef $copy_column
+}
+
+void
+cfg_ir$reverse (cfg_ir_t ir)
+{
+  if (ir->length < 2)
+    return;
+
+  for (size_t lo = 0, hi = ir->length - 1; lo < hi; ++lo, --hi)
+  {
+#define $swap_column(column) \
+  ({ \
+    uint8_t tmp[sizeof (*ir->column)]; \
+    memcpy (tmp, &ir->column[lo], sizeof (tmp)); \
+    memcpy (&ir->column[lo], &ir->column[hi], sizeof (tmp)); \
+    memcpy (&ir->column[hi], tmp, sizeof (tmp)); \
+  })
+    $for_each_column ($swap_column)
+#undef $swap_column
+  }
+}
+
+static inline bool
+is_frame_reg (uint16_t reg)
+{
+  switch (reg)
+  {
+    case X86_REG_RSP:
+    case X86_REG_ESP:
+    case X86_REG_RBP:
+    case X86_REG_EBP:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool
+cfg_ir$get_memloc (cfg_ir_t ir, size_t idx, uint8_t op, cfg_memloc_t* out)
+{
+  $strict_assert (idx < ir->length, "Row index out of bounds");
+  if ((op >= $min (ir->op_count[idx], CFG_IR_MAX_OPERANDS))
+      || (ir->operands[idx][op].type != CFG_IR_OP_MEM))
+    return false;
+
+  auto mem = &ir->operands[idx][op].mem;
+  bool is_plain = (mem->index == X86_REG_INVALID)
+    && (mem->segment == X86_REG_INVALID);
+
+  if (is_plain && (mem->base == X86_REG_RIP))
+  {
+    uint64_t rva = ir->address[idx] + ir->size[idx] + mem->disp;
+    if (rva & ~MEMLOC_RVA_MASK)
+      return false;
+    *out = ((uint64_t)CFG_MEMLOC_GLOBAL << MEMLOC_KIND_SHIFT) | rva;
+    return true;
+  }
+
+  /* every other form keeps its displacement in the low 32 bits, and its
+   * registers in the 8-bit fields above it
+   */
+  if ((mem->disp != (int32_t)mem->disp)
+      || ((mem->base | mem->index | mem->segment) >> MEMLOC_REG_BITS))
+    return false;
+  uint64_t loc = (uint32_t)mem->disp
+    | ((uint64_t)mem->base << 32);
+
+  if (is_plain && is_frame_reg (mem->base))
+  {
+    *out = ((uint64_t)CFG_MEMLOC_STACK << MEMLOC_KIND_SHIFT) | loc;
+    return true;
+  }
+
+  loc |= (uint64_t)mem->index << 40;
+  loc |= (uint64_t)mem->segment << 48;
+  loc |= (uint64_t)(mem->scale ? __builtin_ctz (mem->scale) : 0) << 56;
+  *out = ((uint64_t)CFG_MEMLOC_OTHER << MEMLOC_KIND_SHIFT) | loc;
+  return true;
+}
+
+enum cfg_memloc_kind
+cfg_ir$get_memloc_kind (cfg_memloc_t loc)
+{
+  return loc >> MEMLOC_KIND_SHIFT;
+}
\ No newline at end of file
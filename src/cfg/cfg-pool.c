@@ -0,0 +1,185 @@
+#include <capstone/capstone.h>
+#include <pthread.h>
+
+#include "cfg/cfg-pool.h"
+#include "cfg/cfg-gen.h"
+#include "array.h"
+
+struct pool_callee
+{
+  vertex_tag_t fn_pred;
+  uint64_t address;
+};
+
+struct pool_worker
+{
+  cfg_pool_t pool;
+  pthread_t thread;
+  csh handle, scan_handle;
+  cfg_gen_ctx_t gen;
+};
+
+struct _cfg_pool
+{
+  cfg_t cfg;
+  size_t jobs;
+  struct pool_worker* workers;
+
+  /* guards everything below */
+  pthread_mutex_t lock;
+  /* signalled whenever callees are queued, or a worker goes idle */
+  pthread_cond_t cond;
+  array_t /* struct pool_callee */ queue;
+  /* workers currently generating a function, which may queue more */
+  size_t busy;
+  bool success;
+};
+
+static bool
+take_callee (cfg_pool_t pool, struct pool_callee* out)
+{
+  pthread_mutex_lock (&pool->lock);
+  /* NB: an empty queue only means we're done once nobody can refill it */
+  while (array$is_empty (pool->queue) && pool->busy)
+    pthread_cond_wait (&pool->cond, &pool->lock);
+
+  bool has_work = !array$is_empty (pool->queue);
+  if (has_work)
+  {
+    array$pop (pool->queue, out, array$length (pool->queue) - 1);
+    pool->busy++;
+  }
+  pthread_mutex_unlock (&pool->lock);
+  return has_work;
+}
+
+static void
+finish_callee (struct pool_worker* worker, bool success)
+{
+  auto pool = worker->pool;
+  struct pool_callee callee;
+
+  pthread_mutex_lock (&pool->lock);
+  /* NB: callees already claimed are filtered out by the generator, which
+   *     has to check anyway since it races with the other workers
+   */
+  while (cfg_gen$pop_deferred_callee (
+      worker->gen, &callee.fn_pred, &callee.address))
+    array$append (pool->queue, &callee);
+  pool->success &= success;
+  pool->busy--;
+  pthread_cond_broadcast (&pool->cond);
+  pthread_mutex_unlock (&pool->lock);
+}
+
+static void*
+run_worker (void* param)
+{
+  struct pool_worker* worker = param;
+  struct pool_callee callee;
+  while (take_callee (worker->pool, &callee))
+  {
+    cfg_gen$queue_function_block (worker->gen, callee.fn_pred, callee.address);
+    finish_callee (worker, cfg_gen$generate (worker->gen));
+  }
+  return NULL;
+}
+
+cfg_pool_t
+cfg_pool$new (pe_context_t pe_context, cfg_t cfg, size_t jobs)
+{
+  if (!pe$is_image_mapped (pe_context))
+  {
+    $trace_debug ("parallel generation requires a mapped image");
+    return NULL;
+  }
+
+  auto pool = $chk_allocty (cfg_pool_t);
+  pool->cfg = cfg;
+  pool->jobs = jobs ? jobs : 1;
+  pool->workers = $chk_calloc (pool->jobs, sizeof (*pool->workers));
+  pool->queue = array$new (sizeof (struct pool_callee));
+  pthread_mutex_init (&pool->lock, NULL);
+  pthread_cond_init (&pool->cond, NULL);
+
+  for (size_t i = 0; i < pool->jobs; ++i)
+  {
+    auto worker = &pool->workers[i];
+    worker->pool = pool;
+    if ((cs_open (CS_ARCH_X86, CS_MODE_64, &worker->handle) != CS_ERR_OK)
+        || (cs_open (CS_ARCH_X86, CS_MODE_64, &worker->scan_handle)
+            != CS_ERR_OK))
+      $abort ("failed to initialize Capstone");
+    cs_option (worker->handle, CS_OPT_DETAIL, CS_OPT_ON);
+
+    worker->gen = cfg_gen$new_context (
+      pe_context, cfg, worker->scan_handle, worker->handle);
+    cfg_gen$set_defer_callees (worker->gen, true);
+  }
+  return pool;
+}
+
+void
+cfg_pool$free (cfg_pool_t pool)
+{
+  for (size_t i = 0; i < pool->jobs; ++i)
+  {
+    auto worker = &pool->workers[i];
+    cfg_gen$free_context (worker->gen);
+    cs_close (&worker->handle);
+    cs_close (&worker->scan_handle);
+  }
+  pthread_cond_destroy (&pool->cond);
+  pthread_mutex_destroy (&pool->lock);
+  array$free (pool->queue);
+  $chk_free (pool->workers);
+  $chk_free (pool);
+}
+
+void
+cfg_pool$queue_function_block (cfg_pool_t pool, uint64_t address)
+{
+  pthread_mutex_lock (&pool->lock);
+  array$append (pool->queue, &(struct pool_callee){.address = address});
+  pthread_mutex_unlock (&pool->lock);
+}
+
+bool
+cfg_pool$generate (cfg_pool_t pool)
+{
+  pool->success = true;
+  cfg$set_concurrent (pool->cfg, true);
+  for (size_t i = 0; i < pool->jobs; ++i)
+  {
+    auto worker = &pool->workers[i];
+    if (pthread_create (&worker->thread, NULL, run_worker, worker))
+      $abort ("failed to start cfg. worker %zu", i);
+  }
+  for (size_t i = 0; i < pool->jobs; ++i)
+    pthread_join (pool->workers[i].thread, NULL);
+  cfg$set_concurrent (pool->cfg, false);
+  return pool->success;
+}
+
+void
+cfg_pool$set_max_df_depth (cfg_pool_t pool, size_t depth)
+{
+  for (size_t i = 0; i < pool->jobs; ++i)
+    cfg_gen$set_max_df_depth (pool->workers[i].gen, depth);
+}
+
+struct cfg_decode_stats
+cfg_pool$get_decode_stats (cfg_pool_t pool)
+{
+  struct cfg_decode_stats ret = {0};
+  for (size_t i = 0; i < pool->jobs; ++i)
+  {
+    auto stats = cfg_gen$get_decode_stats (pool->workers[i].gen);
+    ret.hits += stats.hits;
+    ret.misses += stats.misses;
+    ret.insns_decoded += stats.insns_decoded;
+    ret.bytes_decoded += stats.bytes_decoded;
+    ret.details_decoded += stats.details_decoded;
+  }
+  return ret;
+}
\ No newline at end of file
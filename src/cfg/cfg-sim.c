@@ -1,3 +1,4 @@
+#include <string.h>
 #include <x86intrin.h>
 
 #include "capstone/x86.h"
@@ -27,6 +28,7 @@ init_state_fnptrs (cfg_sim_ctx_t sim_ctx, cs_arch arch)
         .set_reg = cfg_sim$x86$set_reg,
         .set_pc = cfg_sim$x86$set_pc,
         .set_flag = cfg_sim$x86$set_flag,
+        .set_flags_lazy = cfg_sim$x86$set_flags_lazy,
       };
       sim_ctx->state = sim_ctx->fn.new_state ();
       break;
@@ -48,32 +50,48 @@ void
 cfg_sim$free (cfg_sim_ctx_t sim_ctx)
 {
   sim_ctx->fn.free_state (sim_ctx->state);
+  $chk_free (sim_ctx->stack_frame);
   $chk_free (sim_ctx);
 }
 
+static uint8_t*
+reset_stack_frame (cfg_sim_ctx_t sim_ctx, vertex_tag_t fn_tag)
+{
+  auto frame_size = cfg$get_function_block_sp_offset (sim_ctx->cfg, fn_tag);
+  if (!frame_size)
+    return NULL;
+  if (frame_size > sim_ctx->stack_frame_capacity)
+  {
+    sim_ctx->stack_frame = $chk_realloc (sim_ctx->stack_frame, frame_size);
+    sim_ctx->stack_frame_capacity = frame_size;
+  }
+  /* NB: the stack grows down from the end of the frame */
+  memset (sim_ctx->stack_frame, 0, frame_size);
+  return sim_ctx->stack_frame + frame_size;
+}
+
 bool
 cfg_sim$simulate_insns (
-  cfg_sim_ctx_t sim_ctx, vertex_tag_t fn_tag, array_t insns)
+  cfg_sim_ctx_t sim_ctx, vertex_tag_t fn_tag, cfg_ir_t insns)
 {
   sim_ctx->fn.reset (sim_ctx->state);
-  auto stack_frame = cfg$new_stack_frame (sim_ctx->cfg, fn_tag);
-  sim_ctx->fn.set_reg (sim_ctx->state, X86_REG_RBP, (uintptr_t)stack_frame);
-  sim_ctx->fn.set_reg (sim_ctx->state, X86_REG_RSP, (uintptr_t)stack_frame);
+  auto stack_frame = reset_stack_frame (sim_ctx, fn_tag);
+  $sim_set_reg (sim_ctx, X86_REG_RBP, (uintptr_t)stack_frame);
+  $sim_set_reg (sim_ctx, X86_REG_RSP, (uintptr_t)stack_frame);
   sim_ctx->fn_tag = fn_tag;
-  $array_for_each($, insns, struct cs_insn, insn)
+  for (size_t i = 0; i < insns->length; ++i)
   {
-    if ($.insn->id == X86_INS_INVALID)
+    if (insns->id[i] == X86_INS_INVALID)
       $abort ("tried to simulate invalid instruction");
     
     $trace_debug (
-      "(trace: %" PRIx64 ") %s %s",
-      $.insn->address, $.insn->mnemonic, $.insn->op_str);
+      "(trace: %" PRIx64 ") %s", insns->address[i], insns->mnemonic[i]);
 
-    sim_ctx->fn.set_pc (sim_ctx->state, $.insn->address + $.insn->size);
+    $sim_set_pc (sim_ctx, insns->address[i] + insns->size[i]);
 
-    auto op_1 = &$.insn->detail->x86.operands[0];
-    auto op_2 = &$.insn->detail->x86.operands[1];
-    switch ($.insn->detail->x86.op_count)
+    auto op_1 = &insns->operands[i][0];
+    auto op_2 = &insns->operands[i][1];
+    switch (insns->op_count[i])
     {
 #define $ret_if_false(expr) \
   { \
@@ -86,33 +104,33 @@ cfg_sim$simulate_insns (
   }
 
       case 0:
-        $ret_if_false(sim_dispatch$nullop (sim_ctx, $.insn));
+        $ret_if_false(sim_dispatch$nullop (sim_ctx, insns, i));
 
       case 1:
-        if (op_1->type == X86_OP_REG)
-          $ret_if_false(sim_dispatch$unop_reg (sim_ctx, $.insn));
-        if (op_1->type == X86_OP_MEM)
-          $ret_if_false(sim_dispatch$unop_mem (sim_ctx, $.insn));
+        if (op_1->type == CFG_IR_OP_REG)
+          $ret_if_false(sim_dispatch$unop_reg (sim_ctx, insns, i));
+        if (op_1->type == CFG_IR_OP_MEM)
+          $ret_if_false(sim_dispatch$unop_mem (sim_ctx, insns, i));
         $abort ("unhandled unop insn. operand type");
         break;
 
       case 2:
-        if ((op_1->type == X86_OP_REG) && (op_2->type == X86_OP_REG))
-          $ret_if_false(sim_dispatch$binop_reg_reg (sim_ctx, $.insn));
-        if ((op_1->type == X86_OP_REG) && (op_2->type == X86_OP_IMM))
-          $ret_if_false(sim_dispatch$binop_reg_imm (sim_ctx, $.insn));
-        if ((op_1->type == X86_OP_REG) && (op_2->type == X86_OP_MEM))
-          $ret_if_false(sim_dispatch$binop_reg_mem (sim_ctx, $.insn));
-        if ((op_1->type == X86_OP_MEM) && (op_2->type == X86_OP_REG))
-          $ret_if_false(sim_dispatch$binop_mem_reg (sim_ctx, $.insn));
-        if ((op_1->type == X86_OP_MEM) && (op_2->type == X86_OP_IMM))
-          $ret_if_false(sim_dispatch$binop_mem_imm (sim_ctx, $.insn));
+        if ((op_1->type == CFG_IR_OP_REG) && (op_2->type == CFG_IR_OP_REG))
+          $ret_if_false(sim_dispatch$binop_reg_reg (sim_ctx, insns, i));
+        if ((op_1->type == CFG_IR_OP_REG) && (op_2->type == CFG_IR_OP_IMM))
+          $ret_if_false(sim_dispatch$binop_reg_imm (sim_ctx, insns, i));
+        if ((op_1->type == CFG_IR_OP_REG) && (op_2->type == CFG_IR_OP_MEM))
+          $ret_if_false(sim_dispatch$binop_reg_mem (sim_ctx, insns, i));
+        if ((op_1->type == CFG_IR_OP_MEM) && (op_2->type == CFG_IR_OP_REG))
+          $ret_if_false(sim_dispatch$binop_mem_reg (sim_ctx, insns, i));
+        if ((op_1->type == CFG_IR_OP_MEM) && (op_2->type == CFG_IR_OP_IMM))
+          $ret_if_false(sim_dispatch$binop_mem_imm (sim_ctx, insns, i));
         $abort ("unhandled binop insn. operand types");
 
       default:
         $abort (
           "unhandled insn. %s has %" PRIu8 " operands",
-          $.insn->mnemonic, $.insn->detail->x86.op_count);
+          insns->mnemonic[i], insns->op_count[i]);
 #undef $ret_if_false
     }
   }
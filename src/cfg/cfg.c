@@ -1,33 +1,73 @@
+#include <pthread.h>
+#include <stdint.h>
+
 #include "cfg/cfg.h"
+#include "arena.h"
 #include "graph.h"
 #include "bitmap.h"
 #include "array.h"
-#include "stack.h"
-#include <stdint.h>
 
 struct _cfg_basic_block
 {
   uint64_t rva;
   uint64_t size;
   bool is_fallthrough;
+  /* allocated on first use, only meaningful while `has_summary` */
+  struct cfg_block_summary* summary;
+  bool has_summary;
 };
 
 struct _cfg_function_block
 {
   vertex_tag_t entry_block;
   graph_t basic_blocks;
-  uint8_t* active_stack_frame;
+  /* block start addresses in ascending order, blocks never overlap so the
+   * containing block is always the closest start at or below an address
+   */
+  array_t /* uint64_t */ block_starts;
   uint64_t sp_offset;
 };
 
 struct _cfg
 {
+  /* owns every graph, edge list and block metadata of the cfg */
+  arena_t arena;
   graph_t functions;
   bitmap_t address_bitmap;
   uint64_t image_base;
-  stack_t stack_frames;
+  /* NB: only taken once the cfg is shared, see `cfg$set_concurrent`. every
+   *     function is only ever generated by one thread, but they all share
+   *     the arena, the function graph and the address bitmap
+   */
+  pthread_rwlock_t lock;
+  bool is_concurrent;
 };
 
+static cfg_t
+lock_cfg (cfg_t cfg, int (*lock_fn)(pthread_rwlock_t*))
+{
+  if (!cfg->is_concurrent)
+    return NULL;
+  lock_fn (&cfg->lock);
+  return cfg;
+}
+
+static void
+unlock_cfg (cfg_t* locked)
+{
+  if (*locked != NULL)
+    pthread_rwlock_unlock (&(*locked)->lock);
+}
+
+/* held until the end of the enclosing scope */
+#define $cfg_lock(cfg, lock_fn) \
+  __attribute__ (( cleanup (unlock_cfg) )) \
+    cfg_t _cfg_locked = lock_cfg ((cfg), (lock_fn)); \
+  (void)_cfg_locked
+
+#define $cfg_read_lock(cfg)  $cfg_lock (cfg, pthread_rwlock_rdlock)
+#define $cfg_write_lock(cfg) $cfg_lock (cfg, pthread_rwlock_wrlock)
+
 static struct _cfg_function_block*
 get_fn_metadata (cfg_t cfg, vertex_tag_t fn_tag)
 {
@@ -55,72 +95,145 @@ get_block_end (cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
   return meta->rva + meta->size;
 }
 
+static size_t
+find_block_start_index (array_t block_starts, uint64_t address)
+{
+  /* index of the first block starting strictly after `address` */
+  size_t lo = 0, hi = array$length (block_starts);
+  while (lo < hi)
+  {
+    auto mid = lo + (hi - lo) / 2;
+    if (*(uint64_t *)array$at (block_starts, mid) <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void
+index_basic_block (struct _cfg_function_block* fn_meta, uint64_t address)
+{
+  auto idx = find_block_start_index (fn_meta->block_starts, address);
+  $strict_assert (
+    !idx || (*(uint64_t *)array$at (fn_meta->block_starts, idx - 1) != address),
+    "Basic block already indexed");
+  array$insert (fn_meta->block_starts, idx, &address);
+}
+
+static struct _cfg_function_block*
+new_fn_metadata (cfg_t cfg)
+{
+  struct _cfg_function_block* metadata
+    = arena$alloc (cfg->arena, sizeof (*metadata));
+  metadata->basic_blocks = graph$new_in (cfg->arena);
+  metadata->block_starts = array$new_in (cfg->arena, sizeof (uint64_t));
+  return metadata;
+}
+
 cfg_t
-cfg$new (uint64_t image_base, uint64_t executable_size)
+cfg$new (uint64_t image_base, uint64_t image_size)
 {
   auto cfg = $chk_allocty (cfg_t);
-  cfg->functions = graph$new ();
-  cfg->address_bitmap = bitmap$new (executable_size);
+  cfg->arena = arena$new ();
+  cfg->functions = graph$new_in (cfg->arena);
+  cfg->address_bitmap = bitmap$new (image_size);
   cfg->image_base = image_base;
-  cfg->stack_frames = stack$new ();
+  pthread_rwlock_init (&cfg->lock, NULL);
   return cfg;
 }
 
 void
 cfg$free (cfg_t cfg)
 {
-  graph$free (cfg->functions);
+  /* graphs and block metadata all live in the arena */
+  arena$free (cfg->arena);
   bitmap$free (cfg->address_bitmap);
-  stack$free (cfg->stack_frames);
+  pthread_rwlock_destroy (&cfg->lock);
   $chk_free (cfg);
 }
 
-vertex_tag_t
-cfg$add_function_block (cfg_t cfg, uint64_t address)
+void
+cfg$set_concurrent (cfg_t cfg, bool is_concurrent)
 {
-  $strict_assert (address != 0, "Function address should be non-zero");
-  auto metadata = $chk_allocty (struct _cfg_function_block*);
-  metadata->basic_blocks = graph$new ();
+  cfg->is_concurrent = is_concurrent;
+}
+
+/* NB: functions are claimed through the function graph alone. the address
+ *     bitmap also covers every block generated so far, and a callee may well
+ *     start inside code another function already walked
+ */
+static vertex_tag_t
+claim_function_block (cfg_t cfg, uint64_t address)
+{
+  if (graph$contains (cfg->functions, address))
+    return 0;
+  auto metadata = new_fn_metadata (cfg);
   auto tag = graph$add_tagged (cfg->functions, address, metadata);
   metadata->entry_block = tag;
   return tag;
 }
 
+vertex_tag_t
+cfg$add_function_block (cfg_t cfg, uint64_t address)
+{
+  $strict_assert (address != 0, "Function address should be non-zero");
+  $cfg_write_lock (cfg);
+  return claim_function_block (cfg, address);
+}
+
 vertex_tag_t
 cfg$add_function_block_succ (cfg_t cfg, vertex_tag_t fn_tag, uint64_t address)
 {
   $strict_assert (address != 0, "Function address should be non-zero");
-  auto metadata = $chk_allocty (struct _cfg_function_block*);
-  metadata->basic_blocks = graph$new ();
-  auto new_tag = graph$add_tagged (cfg->functions, address, metadata);
-  digraph$connect (cfg->functions, fn_tag, new_tag);
-  metadata->entry_block = new_tag;
+  $cfg_write_lock (cfg);
+  auto new_tag = claim_function_block (cfg, address);
+  /* callers of an existing function still get their edge to it */
+  vertex_tag_t callee_tag = new_tag ? new_tag : address;
+  auto callees = digraph$get_egress (cfg->functions, fn_tag);
+  if (!array$contains (callees, &callee_tag))
+    digraph$connect (cfg->functions, fn_tag, callee_tag);
   return new_tag;
 }
 
-vertex_tag_t
-cfg$add_basic_block (cfg_t cfg, vertex_tag_t fn_tag, uint64_t address)
+static vertex_tag_t
+add_basic_block (
+  cfg_t cfg, struct _cfg_function_block* fn_meta, uint64_t address)
 {
   $strict_assert (address != 0, "Basic block address should be non-zero");
-  auto fn_meta = get_fn_metadata (cfg, fn_tag);
-  auto basic_meta = $chk_allocty (struct _cfg_basic_block *);
+  struct _cfg_basic_block* basic_meta
+    = arena$alloc (cfg->arena, sizeof (*basic_meta));
   basic_meta->rva = address; 
   auto tag = graph$add_tagged (fn_meta->basic_blocks, address, basic_meta);
+  index_basic_block (fn_meta, address);
   bitmap$set (cfg->address_bitmap, address);
   return tag;
 }
 
+static void
+set_basic_block_end (
+  cfg_t cfg, struct _cfg_basic_block* basic_meta, uint64_t address)
+{
+  basic_meta->size = address - basic_meta->rva;
+  basic_meta->has_summary = false;
+  bitmap$set_range (cfg->address_bitmap, basic_meta->rva, address);
+}
+
+vertex_tag_t
+cfg$add_basic_block (cfg_t cfg, vertex_tag_t fn_tag, uint64_t address)
+{
+  $cfg_write_lock (cfg);
+  return add_basic_block (cfg, get_fn_metadata (cfg, fn_tag), address);
+}
+
 vertex_tag_t
 cfg$add_basic_block_succ (
   cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag, uint64_t address)
 {
-  $strict_assert (address != 0, "Basic block address should be non-zero");
+  $cfg_write_lock (cfg);
   auto fn_meta = get_fn_metadata (cfg, fn_tag);
-  auto basic_meta = $chk_allocty (struct _cfg_basic_block *);
-  basic_meta->rva = address; 
-  auto new_tag = graph$add_tagged (fn_meta->basic_blocks, address, basic_meta);
+  auto new_tag = add_basic_block (cfg, fn_meta, address);
   digraph$connect (fn_meta->basic_blocks, basic_tag, new_tag);
-  bitmap$set (cfg->address_bitmap, address);
   return new_tag;
 }
 
@@ -128,63 +241,74 @@ void
 cfg$set_function_block_sp_offset (
   cfg_t cfg, vertex_tag_t fn_tag, uint64_t offset)
 {
-  auto fn_meta = get_fn_metadata (cfg, fn_tag);
-  fn_meta->sp_offset = offset;
+  $cfg_read_lock (cfg);
+  /* NB: only the generating thread touches a function's own metadata */
+  get_fn_metadata (cfg, fn_tag)->sp_offset = offset;
+}
+
+uint64_t
+cfg$get_function_block_sp_offset (cfg_t cfg, vertex_tag_t fn_tag)
+{
+  $cfg_read_lock (cfg);
+  return get_fn_metadata (cfg, fn_tag)->sp_offset;
 }
 
 void
 cfg$set_basic_block_end (
   cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag, uint64_t address)
 {
-  auto basic_meta = get_basic_metadata (
-    cfg, fn_tag, basic_tag);
-  basic_meta->size = address - basic_meta->rva;
-  bitmap$set_range (cfg->address_bitmap, basic_meta->rva, address);
+  $cfg_write_lock (cfg);
+  set_basic_block_end (
+    cfg, get_basic_metadata (cfg, fn_tag, basic_tag), address);
 }
 
-struct iter_get_basic_block_param
-{
-  uint64_t out_tag;
-  uint64_t comp;
-};
-
-static bool
-iter_get_basic_block (vertex_tag_t basic_tag, void* metadata, void* param)
+void
+cfg$set_basic_block_summary (
+  cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag,
+  const struct cfg_block_summary* summary)
 {
-  struct iter_get_basic_block_param* iter_param = param;
-  struct _cfg_basic_block* basic_meta = metadata;
-  if (is_address_in_block_range (basic_meta, iter_param->comp))
-  {
-    iter_param->out_tag = basic_tag;
-    return false;
-  }
-  return true;
+  $cfg_write_lock (cfg);
+  auto basic_meta = get_basic_metadata (cfg, fn_tag, basic_tag);
+  if (basic_meta->summary == NULL)
+    basic_meta->summary = arena$alloc (
+      cfg->arena, sizeof (*basic_meta->summary));
+  *basic_meta->summary = *summary;
+  basic_meta->has_summary = true;
 }
 
 vertex_tag_t
 cfg$get_entry_block (cfg_t cfg, vertex_tag_t fn_tag)
 {
+  $cfg_read_lock (cfg);
   return get_fn_metadata (cfg, fn_tag)->entry_block;
 }
 
 vertex_tag_t
 cfg$get_basic_block (cfg_t cfg, vertex_tag_t fn_tag, uint64_t address)
 {
+  /* NB: block ends are only kept in the metadata, so `cfg$set_basic_block_end`
+   *     and splits are reflected here without touching the index
+   */
+  $cfg_read_lock (cfg);
   auto fn_meta = get_fn_metadata (cfg, fn_tag);
-  struct iter_get_basic_block_param param = { .comp = address };
-  if (!graph$for_each_vertex (
-      fn_meta->basic_blocks, iter_get_basic_block, &param))
+  auto idx = find_block_start_index (fn_meta->block_starts, address);
+  if (idx)
   {
-    $trace_debug ("failed to find basic block by address %" PRIx64, address);
-    return 0;
+    vertex_tag_t basic_tag
+      = *(uint64_t *)array$at (fn_meta->block_starts, idx - 1);
+    auto basic_meta = graph$metadata (fn_meta->basic_blocks, basic_tag);
+    if (is_address_in_block_range (basic_meta, address))
+      return basic_tag;
   }
-  return param.out_tag;
+  $trace_debug ("failed to find basic block by address %" PRIx64, address);
+  return 0;
 }
 
 uint64_t
 cfg$get_basic_block_rva (
   cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
 {
+  $cfg_read_lock (cfg);
   auto meta = get_basic_metadata (cfg, fn_tag, basic_tag);
   return meta->rva;
 }
@@ -193,14 +317,25 @@ uint64_t
 cfg$get_basic_block_size (
   cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
 {
+  $cfg_read_lock (cfg);
   auto meta = get_basic_metadata (cfg, fn_tag, basic_tag);
   return meta->size;
 }
 
+const struct cfg_block_summary*
+cfg$get_basic_block_summary (
+  cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
+{
+  $cfg_read_lock (cfg);
+  auto meta = get_basic_metadata (cfg, fn_tag, basic_tag);
+  return meta->has_summary ? meta->summary : NULL;
+}
+
 vertex_tag_t
 cfg$split_basic_block (
   cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t old_tag, uint64_t address)
 {
+  $cfg_write_lock (cfg);
   auto fn_meta = get_fn_metadata (cfg, fn_tag);
   auto old_meta = get_basic_metadata (cfg, fn_tag, old_tag);
 
@@ -212,18 +347,25 @@ cfg$split_basic_block (
     return old_tag;
 
   old_meta->is_fallthrough = true;
-  auto new_block = cfg$add_basic_block_succ (cfg, fn_tag, old_tag, address);
-  cfg$set_basic_block_end (
-    cfg, fn_tag, new_block, old_meta->rva + old_meta->size);
+  auto new_block = add_basic_block (cfg, fn_meta, address);
+  set_basic_block_end (
+    cfg, graph$metadata (fn_meta->basic_blocks, new_block),
+    old_meta->rva + old_meta->size);
   old_meta->size = address - old_meta->rva;
-
-  $array_for_each (
-    $, digraph$get_egress (fn_meta->basic_blocks, old_tag),
-    vertex_tag_t, vertex)
+  /* NB: the head lost its tail, so whatever it defined there is gone */
+  old_meta->has_summary = false;
+
+  /* the tail inherits every successor of the old block, and the egress
+   * array shrinks as we go, so don't iterate it
+   */
+  auto old_egress = digraph$get_egress (fn_meta->basic_blocks, old_tag);
+  while (!array$is_empty (old_egress))
   {
-    digraph$disconnect (fn_meta->basic_blocks, old_tag, *$.vertex);
-    digraph$connect (fn_meta->basic_blocks, new_block, *$.vertex);
+    auto succ = *(vertex_tag_t *)array$at (old_egress, 0);
+    digraph$disconnect (fn_meta->basic_blocks, old_tag, succ);
+    digraph$connect (fn_meta->basic_blocks, new_block, succ);
   }
+  digraph$connect (fn_meta->basic_blocks, old_tag, new_block);
 
   return new_block;
 }
@@ -232,6 +374,7 @@ void
 cfg$connect_basic_blocks (
   cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t a, vertex_tag_t b)
 {
+  $cfg_write_lock (cfg);
   auto fn_meta = get_fn_metadata (cfg, fn_tag);
   digraph$connect (fn_meta->basic_blocks, a, b);
 }
@@ -239,12 +382,14 @@ cfg$connect_basic_blocks (
 bool
 cfg$is_address_visited (cfg_t cfg, uint64_t address)
 {
+  $cfg_read_lock (cfg);
   return bitmap$test (cfg->address_bitmap, address);
 }
 
 array_t
 cfg$get_preds (cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
 {
+  $cfg_read_lock (cfg);
   return digraph$get_ingress (
     get_fn_metadata (cfg, fn_tag)->basic_blocks, basic_tag);
 }
@@ -252,32 +397,23 @@ cfg$get_preds (cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
 array_t
 cfg$get_succs (cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
 {
+  $cfg_read_lock (cfg);
   return digraph$get_egress (
     get_fn_metadata (cfg, fn_tag)->basic_blocks, basic_tag);
 }
 
-uint8_t*
-cfg$new_stack_frame (cfg_t cfg, vertex_tag_t fn_tag)
+size_t
+cfg$get_basic_block_slot (
+  cfg_t cfg, vertex_tag_t fn_tag, vertex_tag_t basic_tag)
 {
-  auto fn_meta = get_fn_metadata (cfg, fn_tag);
-  if (!fn_meta->sp_offset)
-    return NULL;
-  if (fn_meta->active_stack_frame != NULL)
-    return fn_meta->active_stack_frame;
-  fn_meta->active_stack_frame = stack$reserve (
-    cfg->stack_frames, fn_meta->sp_offset);
-  return fn_meta->active_stack_frame;
+  $cfg_read_lock (cfg);
+  return graph$get_slot (
+    get_fn_metadata (cfg, fn_tag)->basic_blocks, basic_tag);
 }
 
-void
-cfg$free_stack_frame (cfg_t cfg, vertex_tag_t fn_tag)
+size_t
+cfg$get_basic_block_count (cfg_t cfg, vertex_tag_t fn_tag)
 {
-  auto fn_meta = get_fn_metadata (cfg, fn_tag);
-  if (fn_meta->active_stack_frame == NULL)
-    $abort ("tried to release non-existent stack frame");
-  $strict_assert (
-    fn_meta->sp_offset != 0,
-    "Function has active stack frame, but invalid sp-offset");
-  stack$unreserve (cfg->stack_frames, fn_meta->sp_offset);
-  fn_meta->active_stack_frame = NULL;
+  $cfg_read_lock (cfg);
+  return graph$get_vertex_count (get_fn_metadata (cfg, fn_tag)->basic_blocks);
 }
\ No newline at end of file
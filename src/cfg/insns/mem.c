@@ -1,7 +1,7 @@
 #include "cfg/insns/dispatch.h"
 
 bool
-sim_dispatch$unop_mem (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
+sim_dispatch$unop_mem (cfg_sim_ctx_t sim_ctx, cfg_ir_t ir, size_t idx)
 {
   __builtin_unimplemented ();
 }
\ No newline at end of file
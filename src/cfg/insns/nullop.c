@@ -2,7 +2,7 @@
 #include "cfg/cfg-sim.h"
 
 bool
-sim_dispatch$nullop (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
+sim_dispatch$nullop (cfg_sim_ctx_t sim_ctx, cfg_ir_t ir, size_t idx)
 {
   return true;
 }
\ No newline at end of file
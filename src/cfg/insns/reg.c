@@ -4,27 +4,28 @@
 static bool
 push_reg (cfg_sim_ctx_t sim_ctx, uint16_t src_reg)
 {
-  $get_regloc_chk (sim_ctx, src_reg, regloc, regmask); (void)regmask;
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx, src_reg);
-  sim_ctx->fn.push_stack (sim_ctx->state, regloc, reg_width);
+  $get_reg_chk (sim_ctx, src_reg, regval, regmask); (void)regmask;
+  auto reg_width = $sim_get_reg_width (sim_ctx, src_reg);
+  $sim_push_stack (sim_ctx, &regval, reg_width / 8);
   return true;
 }
 
 static bool
 pop_reg (cfg_sim_ctx_t sim_ctx, uint16_t dst_reg)
 {
-  $get_regloc_chk (sim_ctx, dst_reg, regloc, regmask); (void)regmask;
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx, dst_reg);
-  sim_ctx->fn.pop_stack (sim_ctx->state, regloc, reg_width);
+  uint64_t regval = 0;
+  auto reg_width = $sim_get_reg_width (sim_ctx, dst_reg);
+  $sim_pop_stack (sim_ctx, &regval, reg_width / 8);
+  $sim_set_reg (sim_ctx, dst_reg, regval);
   return true;
 }
 
 bool
-sim_dispatch$unop_reg (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
+sim_dispatch$unop_reg (cfg_sim_ctx_t sim_ctx, cfg_ir_t ir, size_t idx)
 {
-  auto reg = insn->detail->x86.operands[0].reg;
+  auto reg = ir->operands[idx][0].reg;
 
-  switch (insn->id)
+  switch (ir->id[idx])
   {
 #define $unop_case(insn, fn) \
   case insn: return fn (sim_ctx, reg);
@@ -33,7 +34,7 @@ sim_dispatch$unop_reg (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
     $unop_case (X86_INS_POP, pop_reg);
 
     default:
-      $trace_err ("unhandled reg instruction (%s)", insn->mnemonic);
+      $trace_err ("unhandled reg instruction (%s)", ir->mnemonic[idx]);
       return false;
   }
 }
\ No newline at end of file
@@ -5,27 +5,27 @@
 static bool
 mov_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 {
-  sim_ctx->fn.set_reg (sim_ctx->state, reg, imm);
+  $sim_set_reg (sim_ctx, reg, imm);
   return true;
 }
 
 static bool
 movabs_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 {
-  sim_ctx->fn.set_reg (sim_ctx->state, reg, imm);
+  $sim_set_reg (sim_ctx, reg, imm);
   return true;
 }
 
 static bool
 add_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 {
-  $get_regloc_chk(sim_ctx, reg, regloc, regmask);
-  auto op_1 = *regloc & regmask;
+  $get_reg_chk(sim_ctx, reg, regval, regmask);
+  auto op_1 = regval;
   auto op_2 = imm & regmask;
   auto result = (op_1 + op_2) & regmask;
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg);
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg);
   
-  sim_ctx->fn.set_reg (sim_ctx->state, reg, result);
+  $sim_set_reg (sim_ctx, reg, result);
   sim_dispatch$update_flags__arith (
     sim_ctx, reg_width, result, op_1, op_2, false);
   return true;
@@ -34,10 +34,10 @@ add_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 static bool
 rol_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 {
-  $get_regloc_chk(sim_ctx, reg, regloc, regmask);
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg);
-  uint64_t shifted = __rolg (*regloc & regmask, imm, reg_width);
-  sim_ctx->fn.set_reg (sim_ctx->state, reg, shifted);
+  $get_reg_chk(sim_ctx, reg, regval, regmask);
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg);
+  uint64_t shifted = __rolg (regval, imm, reg_width);
+  $sim_set_reg (sim_ctx, reg, shifted);
   sim_dispatch$update_flags__rot (sim_ctx, imm, shifted, reg_width);
   return true;
 }
@@ -45,10 +45,10 @@ rol_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 static bool
 ror_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 {
-  $get_regloc_chk(sim_ctx, reg, regloc, regmask);
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg);
-  uint64_t shifted = __rorg (*regloc & regmask, imm, reg_width);
-  sim_ctx->fn.set_reg (sim_ctx->state, reg, shifted);
+  $get_reg_chk(sim_ctx, reg, regval, regmask);
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg);
+  uint64_t shifted = __rorg (regval, imm, reg_width);
+  $sim_set_reg (sim_ctx, reg, shifted);
   sim_dispatch$update_flags__rot (sim_ctx, imm, shifted, reg_width);
   return true;
 }
@@ -56,10 +56,10 @@ ror_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 static bool
 cmp_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 {
-  $get_regloc_chk(sim_ctx, reg, regloc, regmask);
-  auto op_1 = *regloc & regmask;
+  $get_reg_chk(sim_ctx, reg, regval, regmask);
+  auto op_1 = regval;
   auto result = op_1 - imm;
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg);
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg);
   
   sim_dispatch$update_flags__arith (
     sim_ctx, reg_width, result, op_1, imm, true);
@@ -67,11 +67,11 @@ cmp_reg_imm (cfg_sim_ctx_t sim_ctx, uint16_t reg, uint64_t imm)
 }
 
 bool
-sim_dispatch$binop_reg_imm (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
+sim_dispatch$binop_reg_imm (cfg_sim_ctx_t sim_ctx, cfg_ir_t ir, size_t idx)
 {
-  auto operands = insn->detail->x86.operands;
+  auto operands = ir->operands[idx];
 
-  switch (insn->id)
+  switch (ir->id[idx])
   {
 #define $binop_case(ins, fn) \
   case ins: return fn (sim_ctx, operands[0].reg, operands[1].imm);
@@ -84,7 +84,7 @@ sim_dispatch$binop_reg_imm (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
     $binop_case (X86_INS_CMP, cmp_reg_imm);
     
     default:
-      $trace_err ("unhandled reg/imm. instruction (%s)", insn->mnemonic);
+      $trace_err ("unhandled reg/imm. instruction (%s)", ir->mnemonic[idx]);
       return false;
   }
 }
\ No newline at end of file
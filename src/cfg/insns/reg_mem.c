@@ -1,33 +1,34 @@
-#include "capstone/x86.h"
 #include "cfg/insns/dispatch.h"
 #include "cfg/cfg-sim.h"
 
 static bool
-lea_reg_mem (cfg_sim_ctx_t sim_ctx, uint16_t dst_reg, struct x86_op_mem* mem)
+lea_reg_mem (
+  cfg_sim_ctx_t sim_ctx, uint16_t dst_reg, const struct cfg_ir_mem* mem)
 {
   uint64_t sib;
   if (!sim_dispatch$resolve_memop (sim_ctx, mem, &sib))
     return false;
-  sim_ctx->fn.set_reg (sim_ctx->state, dst_reg, sib);
+  $sim_set_reg (sim_ctx, dst_reg, sib);
   return true;
 }
 
 static bool
-mov_reg_mem (cfg_sim_ctx_t sim_ctx, uint16_t dst_reg, struct x86_op_mem* mem)
+mov_reg_mem (
+  cfg_sim_ctx_t sim_ctx, uint16_t dst_reg, const struct cfg_ir_mem* mem)
 {
   uint64_t sib;
   if (!sim_dispatch$resolve_memop (sim_ctx, mem, &sib))
     return false;
-  sim_ctx->fn.set_reg (sim_ctx->state, dst_reg, *(uint64_t *)sib);
+  $sim_set_reg (sim_ctx, dst_reg, *(uint64_t *)sib);
   return true;
 }
 
 bool
-sim_dispatch$binop_reg_mem (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
+sim_dispatch$binop_reg_mem (cfg_sim_ctx_t sim_ctx, cfg_ir_t ir, size_t idx)
 {
-  auto operands = insn->detail->x86.operands;
+  auto operands = ir->operands[idx];
 
-  switch (insn->id)
+  switch (ir->id[idx])
   {
 #define $binop_case(insn, fn) \
   case insn: \
@@ -37,7 +38,7 @@ sim_dispatch$binop_reg_mem (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
     $binop_case (X86_INS_MOV, mov_reg_mem);
 
     default:
-      $trace_err ("unhandled reg/mem. instruction (%s)", insn->mnemonic);
+      $trace_err ("unhandled reg/mem. instruction (%s)", ir->mnemonic[idx]);
       return false;
   }
 }
\ No newline at end of file
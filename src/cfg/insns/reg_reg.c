@@ -5,31 +5,31 @@
 static bool
 mov_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_dst, uint16_t reg_src)
 {
-  $get_regloc_chk(sim_ctx, reg_src, src_loc, src_mask);
-  sim_ctx->fn.set_reg (sim_ctx->state, reg_dst, *src_loc & src_mask);
+  $get_reg_chk(sim_ctx, reg_src, src_val, src_mask);
+  $sim_set_reg (sim_ctx, reg_dst, src_val);
   return true;
 }
 
 static bool
 movsxd_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_dst, uint16_t reg_src)
 {
-  $get_regloc_chk(sim_ctx, reg_src, src_loc, src_mask);
-  uint64_t sx_val = (int64_t)((int32_t)(*src_loc & src_mask));
-  sim_ctx->fn.set_reg (sim_ctx->state, reg_dst, sx_val);
+  $get_reg_chk(sim_ctx, reg_src, src_val, src_mask);
+  uint64_t sx_val = (int64_t)((int32_t)src_val);
+  $sim_set_reg (sim_ctx, reg_dst, sx_val);
   return true;
 }
 
 static bool
 add_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_a, uint16_t reg_b)
 {
-  $get_regloc_chk(sim_ctx, reg_a, loc_a, mask_a);
-  $get_regloc_chk(sim_ctx, reg_b, loc_b, mask_b);
-  auto op_1 = *loc_a & mask_a;
-  auto op_2 = *loc_b & mask_b;
+  $get_reg_chk(sim_ctx, reg_a, val_a, mask_a);
+  $get_reg_chk(sim_ctx, reg_b, val_b, mask_b);
+  auto op_1 = val_a;
+  auto op_2 = val_b;
   auto result = (op_1 + op_2) & mask_a;
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg_a);
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg_a);
   
-  sim_ctx->fn.set_reg (sim_ctx->state, reg_a, result);
+  $sim_set_reg (sim_ctx, reg_a, result);
   sim_dispatch$update_flags__arith (
     sim_ctx, reg_width, result, op_1, op_2, false);
   return true;
@@ -38,15 +38,14 @@ add_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_a, uint16_t reg_b)
 static bool
 rol_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_dst, uint16_t reg_src)
 {
-  $get_regloc_chk(sim_ctx, reg_dst, dst_loc, dst_mask);
-  $get_regloc_chk(sim_ctx, reg_src, src_loc, src_mask);
+  $get_reg_chk(sim_ctx, reg_dst, dst_val, dst_mask);
+  $get_reg_chk(sim_ctx, reg_src, src_val, src_mask);
 
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg_dst);
-  auto shift_val = *src_loc & src_mask;
-  auto val = *dst_loc & dst_mask;
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg_dst);
+  auto shift_val = src_val;
+  auto val = dst_val;
 
-  sim_ctx->fn.set_reg (
-    sim_ctx->state, reg_dst, __rolg (val, shift_val, reg_width));
+  $sim_set_reg (sim_ctx, reg_dst, __rolg (val, shift_val, reg_width));
   sim_dispatch$update_flags__rot (sim_ctx, shift_val, val, reg_width);
 
   return true;
@@ -55,15 +54,14 @@ rol_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_dst, uint16_t reg_src)
 static bool
 ror_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_dst, uint16_t reg_src)
 {
-  $get_regloc_chk(sim_ctx, reg_dst, dst_loc, dst_mask);
-  $get_regloc_chk(sim_ctx, reg_src, src_loc, src_mask);
+  $get_reg_chk(sim_ctx, reg_dst, dst_val, dst_mask);
+  $get_reg_chk(sim_ctx, reg_src, src_val, src_mask);
 
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg_dst);
-  auto shift_val = *src_loc & src_mask;
-  auto val = *dst_loc & dst_mask;
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg_dst);
+  auto shift_val = src_val;
+  auto val = dst_val;
 
-  sim_ctx->fn.set_reg (
-    sim_ctx->state, reg_dst, __rorg (val, shift_val, reg_width));
+  $sim_set_reg (sim_ctx, reg_dst, __rorg (val, shift_val, reg_width));
   sim_dispatch$update_flags__rot (sim_ctx, shift_val, val, reg_width);
 
   return true;
@@ -72,14 +70,14 @@ ror_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_dst, uint16_t reg_src)
 static bool
 cmp_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_a, uint16_t reg_b)
 {
-  $get_regloc_chk(sim_ctx, reg_a, loc_a, mask_a);
-  $get_regloc_chk(sim_ctx, reg_b, loc_b, mask_b);
+  $get_reg_chk(sim_ctx, reg_a, val_a, mask_a);
+  $get_reg_chk(sim_ctx, reg_b, val_b, mask_b);
 
-  auto op_1 = *loc_a & mask_a;
-  auto op_2 = *loc_b & mask_b;
+  auto op_1 = val_a;
+  auto op_2 = val_b;
   $trace ("comparing %" PRIx64 " to %" PRIx64, op_1, op_2);
   auto result = op_1 - op_2;
-  auto reg_width = sim_ctx->fn.get_reg_width (sim_ctx->state, reg_a);
+  auto reg_width = $sim_get_reg_width (sim_ctx, reg_a);
   
   sim_dispatch$update_flags__arith (
     sim_ctx, reg_width, result, op_1, op_2, true);
@@ -87,11 +85,11 @@ cmp_reg_reg (cfg_sim_ctx_t sim_ctx, uint16_t reg_a, uint16_t reg_b)
 }
 
 bool
-sim_dispatch$binop_reg_reg (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
+sim_dispatch$binop_reg_reg (cfg_sim_ctx_t sim_ctx, cfg_ir_t ir, size_t idx)
 {
-  auto operands = insn->detail->x86.operands;
+  auto operands = ir->operands[idx];
 
-  switch (insn->id)
+  switch (ir->id[idx])
   {
 #define $binop_case(ins, fn) \
   case ins: return fn (sim_ctx, operands[0].reg, operands[1].reg);
@@ -104,7 +102,7 @@ sim_dispatch$binop_reg_reg (cfg_sim_ctx_t sim_ctx, cs_insn* insn)
     $binop_case (X86_INS_CMP, cmp_reg_reg);
 
     default:
-      $trace_err ("unhandled reg/reg. instruction (%s)", insn->mnemonic);
+      $trace_err ("unhandled reg/reg. instruction (%s)", ir->mnemonic[idx]);
       return false;
   }
 }
\ No newline at end of file
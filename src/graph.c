@@ -3,69 +3,90 @@
 #include "map.h"
 #include <stdbool.h>
 
+/* most vertices in a control-flow graph have at most two edges each way */
+#define GRAPH_INLINE_EDGES 2
+
 struct graph_vertex
 {
   vertex_tag_t tag;
   void* metadata;
+  array_t /* vertex-tag */ egress;
+  array_t /* vertex-tag */ ingress;
 };
 
 struct _graph
 {
-  map_t /* vertex-tag -> array[vertex-tag] */ map_vertex_edges;
+  arena_t arena;
+  /* vertices are stored densely, and never change slot once added */
   array_t /* struct graph_vertex */ vertices;
+  map_t /* vertex-tag -> slot + 1 */ map_tag_slot;
   vertex_tag_t tag_counter;
 };
 
 static struct graph_vertex*
 get_vertex (graph_t graph, vertex_tag_t tag)
 {
-  $array_for_each ($, graph->vertices, struct graph_vertex, vertex)
-  {
-    if ($.vertex->tag == tag)
-      return $.vertex;
-  }
-  return NULL;
+  uintptr_t slot = (uintptr_t)map$get (graph->map_tag_slot, tag);
+  if (!slot)
+    return NULL;
+  return array$at (graph->vertices, slot - 1);
 }
 
-static array_t
-get_vertex_edges (graph_t graph, vertex_tag_t tag)
+static struct graph_vertex*
+get_vertex_chk (graph_t graph, vertex_tag_t tag)
 {
-  array_t edges = map$get (graph->map_vertex_edges, tag);
-  $strict_assert (edges != NULL, "No edge array for vertex");
-  return edges;
+  auto vertex = get_vertex (graph, tag);
+  $strict_assert (vertex != NULL, "No such vertex");
+  return vertex;
+}
+
+static vertex_tag_t
+add_vertex (graph_t graph, vertex_tag_t tag, void* metadata)
+{
+  struct graph_vertex vertex = {
+    .tag = tag,
+    .metadata = metadata,
+    .egress = array$new_inline_in (
+      graph->arena, sizeof (vertex_tag_t), GRAPH_INLINE_EDGES),
+    .ingress = array$new_inline_in (
+      graph->arena, sizeof (vertex_tag_t), GRAPH_INLINE_EDGES)
+  };
+  array$append (graph->vertices, &vertex);
+  map$set (
+    graph->map_tag_slot, tag,
+    (void *)(uintptr_t)array$length (graph->vertices));
+  return tag;
 }
 
 graph_t
 graph$new (void)
 {
-  $trace_debug ("allocating graph");
-  auto graph = $chk_allocty (graph_t);
-  graph->map_vertex_edges = map$new ();
-  graph->vertices = array$new (sizeof (struct graph_vertex));
-  array$allocopts (graph->vertices, (struct array_allocopts){
-    .alloc_nmemb_increment = 1,
-    .trim_nmemb_threshold = 1
-  });
-  return graph;
+  return graph$new_in (NULL);
 }
 
-static bool
-iter_vertex_edges_free (void* data, hashnum_t key, void* value)
+graph_t
+graph$new_in (arena_t arena)
 {
-  (void)data; (void)key;
-  array_t edges = value;
-  array$free (edges);
-  return true;
+  $trace_debug ("allocating graph");
+  graph_t graph = arena$alloc (arena, sizeof (*graph));
+  graph->arena = arena;
+  graph->map_tag_slot = map$new_in (arena);
+  graph->vertices = array$new_in (arena, sizeof (struct graph_vertex));
+  return graph;
 }
 
 void
 graph$free (graph_t graph)
 {
   $trace_debug ("freeing graph");
+  $array_for_each ($, graph->vertices, struct graph_vertex, vertex)
+  {
+    array$free ($.vertex->egress);
+    array$free ($.vertex->ingress);
+  }
   array$free (graph->vertices);
-  map$for_each_pair (graph->map_vertex_edges, iter_vertex_edges_free, NULL);
-  map$free (graph->map_vertex_edges);
-  $chk_free (graph);
+  map$free (graph->map_tag_slot);
+  arena$dealloc (graph->arena, graph);
 }
 
 vertex_tag_t
@@ -73,29 +94,17 @@ graph$add (graph_t graph, void* metadata)
 {
   auto tag = graph->tag_counter++;
   $trace_debug ("adding new node with tag %zu", tag);
-  struct graph_vertex vertex = { .metadata = metadata, .tag = tag};
-  array$append (graph->vertices, &vertex);
-  auto edges = array$new (sizeof (vertex_tag_t));
-  map$set (graph->map_vertex_edges, tag, edges);
-  return tag;
+  return add_vertex (graph, tag, metadata);
 }
 
 vertex_tag_t
 graph$add_tagged (graph_t graph, vertex_tag_t tag, void* metadata)
 {
   $trace_debug ("adding new node with preset tag %zu", tag);
-#ifdef STRICT
-  $array_for_each ($, graph->vertices, struct graph_vertex, vertex)
-  {
-    if ($.vertex->tag == tag)
-      $abort ("preset tag already exists in vertices");
-  }
-#endif
-  struct graph_vertex vertex = { .metadata = metadata, .tag = tag };
-  array$append (graph->vertices, &vertex);
-  auto edges = array$new (sizeof (vertex_tag_t));
-  map$set (graph->map_vertex_edges, tag, edges);
-  return tag;
+  $strict_assert (
+    !map$contains (graph->map_tag_slot, tag),
+    "Preset tag already exists in vertices");
+  return add_vertex (graph, tag, metadata);
 }
 
 void
@@ -105,12 +114,13 @@ digraph$connect (graph_t graph, vertex_tag_t a, vertex_tag_t b)
     (get_vertex (graph, a) != NULL) 
     && (get_vertex (graph, b) != NULL),
     "Invalid vertex tags");
-  array_t edges = get_vertex_edges (graph, a);
+  auto vertex_a = get_vertex_chk (graph, a);
   $strict_assert (
-    !array$contains (edges, &b),
+    !array$contains (vertex_a->egress, &b),
     "Vertex cannot connect to another more than once");
   $trace_debug ("connected node %zu to node %zu", a, b);
-  array$append (edges, &b);
+  array$append (vertex_a->egress, &b);
+  array$append (get_vertex_chk (graph, b)->ingress, &a);
 }
 
 void
@@ -120,65 +130,53 @@ graph$connect (graph_t graph, vertex_tag_t a, vertex_tag_t b)
   digraph$connect (graph, b, a);
 }
 
+/* NB: egress/ingress arrays are borrowed, and are only valid until the
+ *     vertex's edges are next modified
+ */
+
 array_t
 digraph$get_egress (graph_t graph, vertex_tag_t tag)
 {
-  return get_vertex_edges (graph, tag);
-}
-
-struct iter_get_ingress_param
-{
-  array_t ingress_array;
-  vertex_tag_t comparand;
-};
-
-static bool
-iter_get_ingress (void* data, hashnum_t key, void* value)
-{
-  struct iter_get_ingress_param* param = data;
-  array_t edges = value;
-  $array_for_each ($, edges, vertex_tag_t, tag)
-  {
-    if (*$.tag == param->comparand)
-      array$append (param->ingress_array, &key);
-  }
-  return true;
+  return get_vertex_chk (graph, tag)->egress;
 }
 
 array_t
 digraph$get_ingress (graph_t graph, vertex_tag_t tag)
 {
-  struct iter_get_ingress_param param = {
-    .ingress_array = array$new (sizeof (vertex_tag_t)),
-    .comparand = tag
-  };
-  map$for_each_pair (graph->map_vertex_edges, iter_get_ingress, &param);
-  return param.ingress_array;
+  return get_vertex_chk (graph, tag)->ingress;
 }
 
 array_t
 graph$get_edges (graph_t graph, vertex_tag_t tag)
 {
-  array_t ingress = digraph$get_ingress (graph, tag);
-  array$concat (ingress, digraph$get_egress (graph, tag));
-  return ingress;
+  auto vertex = get_vertex_chk (graph, tag);
+  array_t edges = array$new (sizeof (vertex_tag_t));
+  array$concat (edges, vertex->ingress);
+  array$concat (edges, vertex->egress);
+  return edges;
 }
 
-void
-digraph$disconnect (graph_t graph, vertex_tag_t a, vertex_tag_t b)
+static void
+remove_edge (array_t edges, vertex_tag_t tag)
 {
-  $trace_debug ("disconnecting node %zu from node %zu", a, b);
-  auto edges = get_vertex_edges (graph, a);
-  $array_for_each ($, edges, vertex_tag_t, tag)
+  $array_for_each ($, edges, vertex_tag_t, edge)
   {
-    if (*$.tag == b)
+    if (*$.edge == tag)
     {
       array$remove (edges, $.i);
-      break;
+      return;
     }
   }
 }
 
+void
+digraph$disconnect (graph_t graph, vertex_tag_t a, vertex_tag_t b)
+{
+  $trace_debug ("disconnecting node %zu from node %zu", a, b);
+  remove_edge (get_vertex_chk (graph, a)->egress, b);
+  remove_edge (get_vertex_chk (graph, b)->ingress, a);
+}
+
 void
 graph$disconnect (graph_t graph, vertex_tag_t a, vertex_tag_t b)
 {
@@ -192,6 +190,26 @@ graph$metadata (graph_t graph, vertex_tag_t tag)
   return get_vertex (graph, tag)->metadata;
 }
 
+bool
+graph$contains (graph_t graph, vertex_tag_t tag)
+{
+  return map$contains (graph->map_tag_slot, tag);
+}
+
+size_t
+graph$get_slot (graph_t graph, vertex_tag_t tag)
+{
+  uintptr_t slot = (uintptr_t)map$get (graph->map_tag_slot, tag);
+  $strict_assert (slot, "No such vertex");
+  return slot - 1;
+}
+
+size_t
+graph$get_vertex_count (graph_t graph)
+{
+  return array$length (graph->vertices);
+}
+
 bool
 graph$for_each_vertex (graph_t graph, iter_vertex_t callback, void* param)
 {
@@ -10,6 +10,7 @@
 #include "pe/context.h"
 #include "pe/format.h"
 #include "cfg/cfg-gen.h"
+#include "cfg/cfg-pool.h"
 #include "cfg/cfg.h"
 #include "trace.h"
 
@@ -19,12 +20,23 @@ static char args_doc[] = "FILE";
 static struct argp_option options[] = {
   { "file", 'c', "FILE", 0, "Path to PE image", 0 },
   { "entry", 'e', "ADDR", 0, "Entry point of PE image", 0 },
+  { "df-depth", 'd', "N", 0,
+    "Maximum number of blocks a dataflow slice walks back", 0 },
+  { "jobs", 'j', "N", 0, "Number of functions generated in parallel", 0 },
+  { "all-roots", 'a', 0, 0,
+    "Also generate every exported function and TLS callback", 0 },
+  { "seed-pdata", 'p', 0, 0,
+    "Also generate every function listed in the exception directory", 0 },
   { 0 }
 };
 
 struct arguments
 {
   uint64_t entry_point;
+  size_t df_depth;
+  size_t jobs;
+  bool all_roots;
+  bool seed_pdata;
   char* file_path;
 };
 
@@ -37,6 +49,20 @@ parse_opt (int key, char* arg, struct argp_state* state)
     case 'e':
       args->entry_point = strtoull (arg, NULL, 0);
       break;
+    case 'd':
+      args->df_depth = strtoull (arg, NULL, 0);
+      break;
+    case 'j':
+      args->jobs = strtoull (arg, NULL, 0);
+      if (!args->jobs)
+        argp_error (state, "at least one job is required");
+      break;
+    case 'a':
+      args->all_roots = true;
+      break;
+    case 'p':
+      args->seed_pdata = true;
+      break;
     case 'c':
       args->file_path = arg;
       break;
@@ -57,11 +83,31 @@ parse_opt (int key, char* arg, struct argp_state* state)
 
 static struct argp argp = { options, parse_opt, args_doc, doc, 0, 0, 0 };
 
+/* NB: stray pointers don't land in executable sections, so they're dropped
+ *     rather than generated as garbage
+ */
+static void
+add_root (pe_context_t pe_context, array_t roots, uint64_t rva)
+{
+  auto section = pe$find_section_by_rva (pe_context, rva);
+  if ((section == NULL)
+      || !(section->characteristics & IMAGE_SCN_MEM_EXECUTE))
+  {
+    $trace_debug ("skipping non-executable root: +0x%" PRIx64, rva);
+    return;
+  }
+  array$append (roots, &rva);
+}
+
 int
 main (int argc, char** argv)
 {
   struct arguments args;
   args.entry_point = 0;
+  args.df_depth = MAX_DF_BLOCK_DEPTH;
+  args.jobs = 1;
+  args.all_roots = false;
+  args.seed_pdata = false;
   argp_parse (&argp, argc, argv, 0, 0, &args);
 
   auto file = fopen (args.file_path, "rb");
@@ -71,7 +117,8 @@ main (int argc, char** argv)
 
   auto pe_context = pe$from_file (
     file, PE_CONTEXT_LOAD_IMPORT_DIRECTORY | PE_CONTEXT_LOAD_EXPORT_DIRECTORY
-      | PE_CONTEXT_LOAD_TLS_DIRECTORY);
+      | PE_CONTEXT_LOAD_TLS_DIRECTORY | PE_CONTEXT_LOAD_EXCEPTION_DIRECTORY
+      | PE_CONTEXT_MAP_IMAGE);
   if (pe_context == NULL)
     $abort ("failed to create PE context from file");
 
@@ -86,23 +133,100 @@ main (int argc, char** argv)
     $abort ("section containing entry-point is non-executable");
   $trace ("configured analysis entry-point: +0x%" PRIx64, args.entry_point);
 
+  /* every root is generated into the same cfg, so functions reachable from
+   * several of them are still only generated once
+   */
+  auto roots = array$new (sizeof (uint64_t));
+  array$append (roots, &args.entry_point);
+  if (args.all_roots)
+  {
+    $array_for_each (
+      $, pe_context->exports.functions, struct export_func_entry, entry)
+    {
+      if (!$.entry->is_forwarded)
+        add_root (pe_context, roots, $.entry->rva.address);
+    }
+    $array_for_each ($, pe_context->tls.callbacks, uint64_t, callback)
+    {
+      add_root (pe_context, roots, pe$va_to_rva (pe_context, *$.callback));
+    }
+    $trace (
+      "added %zu roots from exports and TLS callbacks",
+      array$length (roots) - 1);
+  }
+  if (args.seed_pdata)
+  {
+    auto nr_roots = array$length (roots);
+    $array_for_each (
+      $, pe_context->runtime_functions, struct image_runtime_function_entry,
+      function)
+    {
+      if (pe$is_runtime_function_chained (pe_context, $.function))
+        continue;
+      add_root (pe_context, roots, $.function->begin_address);
+    }
+    $trace (
+      "seeded %zu functions from the exception directory",
+      array$length (roots) - nr_roots);
+  }
+
   auto cfg = cfg$new (
-    pe$get_image_base (pe_context), entry_section->size_of_raw_data);
+    pe$get_image_base (pe_context),
+    pe_context->nt_header.optional_header.size_of_image);
 
-  csh handle;
-  if (cs_open (CS_ARCH_X86, CS_MODE_64, &handle) != CS_ERR_OK)
-    $abort ("failed to initialize Capstone");
-  cs_option (handle, CS_OPT_DETAIL, CS_OPT_ON);
+  cfg_pool_t cfg_pool = NULL;
+  if (args.jobs > 1)
+  {
+    cfg_pool = cfg_pool$new (pe_context, cfg, args.jobs);
+    if (cfg_pool == NULL)
+      $trace_err ("image couldn't be mapped, generating with a single job");
+  }
 
-  auto cfg_gen_ctx = cfg_gen$new_context (pe_context, cfg, handle);
+  struct cfg_decode_stats decode_stats;
+  if (cfg_pool != NULL)
+  {
+    cfg_pool$set_max_df_depth (cfg_pool, args.df_depth);
+
+    $array_for_each ($, roots, uint64_t, address)
+      cfg_pool$queue_function_block (cfg_pool, *$.address);
+    if (!cfg_pool$generate (cfg_pool))
+      $abort ("failed to generate basic blocks");
+
+    decode_stats = cfg_pool$get_decode_stats (cfg_pool);
+    cfg_pool$free (cfg_pool);
+  }
+  else
+  {
+    csh handle, scan_handle;
+    if ((cs_open (CS_ARCH_X86, CS_MODE_64, &handle) != CS_ERR_OK)
+        || (cs_open (CS_ARCH_X86, CS_MODE_64, &scan_handle) != CS_ERR_OK))
+      $abort ("failed to initialize Capstone");
+    cs_option (handle, CS_OPT_DETAIL, CS_OPT_ON);
+
+    auto cfg_gen_ctx = cfg_gen$new_context (
+      pe_context, cfg, scan_handle, handle);
+    cfg_gen$set_max_df_depth (cfg_gen_ctx, args.df_depth);
+
+    $array_for_each ($, roots, uint64_t, address)
+      cfg_gen$queue_function_block (cfg_gen_ctx, 0, *$.address);
+    if (!cfg_gen$generate (cfg_gen_ctx))
+      $abort ("failed to generate basic blocks");
+
+    decode_stats = cfg_gen$get_decode_stats (cfg_gen_ctx);
+    cfg_gen$free_context (cfg_gen_ctx);
+    cs_close (&handle);
+    cs_close (&scan_handle);
+  }
 
-  if (!cfg_gen$recurse_function_block (cfg_gen_ctx, 0, args.entry_point))
-    $abort ("failed to generate basic blocks");
+  $trace (
+    "decode cache: %zu hits, %zu misses, %zu insns (%zu bytes) scanned, "
+    "%zu details decoded",
+    decode_stats.hits, decode_stats.misses, decode_stats.insns_decoded,
+    decode_stats.bytes_decoded, decode_stats.details_decoded);
 
-  cfg_gen$free_context (cfg_gen_ctx);
+  array$free (roots);
   cfg$free (cfg);
   pe$free (pe_context);
-  cs_close (&handle);
   fclose (file);
 
   return EXIT_SUCCESS;
@@ -2,34 +2,35 @@
 #include <string.h>
 
 #include "map.h"
-#include "array.h"
 
-#define NR_INITIAL_BUCKETS    (16)
+#define MAP_INITIAL_CAPACITY  (16)
 _Static_assert (
-  !(NR_INITIAL_BUCKETS & (NR_INITIAL_BUCKETS - 1)),
-  "Bucket count should be a power of 2");
+  !(MAP_INITIAL_CAPACITY & (MAP_INITIAL_CAPACITY - 1)),
+  "Map capacity should be a power of 2");
+/* grow once more than 7/8ths of the slots are occupied */
+#define MAP_LOAD_FACTOR_NUM   (7)
+#define MAP_LOAD_FACTOR_DEN   (8)
 #define FNV1A64_PRIME         (1099511628211ull)
 #define FNV1A64_OFFSET_BASIS  (14695981039346656037ull)
 
-#define $map_for_each_bucket(tag, map, name) \
-  $array_for_each (tag, (map)->buckets, struct map_bucket, name)
-#define $bucket_for_each_entry(tag, bucket, name) \
-  $array_for_each (tag, (bucket)->entries, struct map_bucket_entry, name)
-
-struct map_bucket_entry
+/* open-addressed, Robin Hood probing with backward-shift deletion; entries
+ * are ordered within a probe sequence by their distance from their home slot,
+ * which bounds lookups of missing keys without tombstones
+ */
+struct map_slot
 {
   hashnum_t hashnum;
   void* value;
-};
-
-struct map_bucket
-{
-  array_t /* struct map_bucket_entry */ entries; 
+  /* probe distance from the home slot plus one, zero if the slot is empty */
+  uint32_t distance;
 };
 
 struct _map
 {
-  array_t /* struct map_bucket */ buckets;
+  arena_t arena;
+  struct map_slot* slots;
+  size_t capacity;
+  size_t count;
 };
 
 hashnum_t
@@ -65,138 +66,193 @@ map$compute_hash (uint64_t octet)
   return compute_fnv1a64_hash (&octet, sizeof (octet));
 }
 
-size_t
-get_bucket_count (map_t map)
+static inline size_t
+get_home_slot (map_t map, hashnum_t key)
+{
+  /* keys are frequently addresses rather than proper hashes, so scramble
+   * them before masking (murmur3 finaliser)
+   */
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdull;
+  key ^= key >> 33;
+  key *= 0xc4ceb9fe1a85ec53ull;
+  key ^= key >> 33;
+  return key & (map->capacity - 1);
+}
+
+static struct map_slot*
+find_slot (map_t map, hashnum_t key)
+{
+  auto mask = map->capacity - 1;
+  auto idx = get_home_slot (map, key);
+  for (uint32_t distance = 1;; ++distance, idx = (idx + 1) & mask)
+  {
+    auto slot = &map->slots[idx];
+    /* a poorer entry (or an empty slot) means the key would've been placed
+     * here already, so it doesn't exist
+     */
+    if (slot->distance < distance)
+      return NULL;
+    if (slot->hashnum == key)
+      return slot;
+  }
+}
+
+static void
+insert_slot (map_t map, struct map_slot entry)
+{
+  auto mask = map->capacity - 1;
+  auto idx = get_home_slot (map, entry.hashnum);
+  for (entry.distance = 1;; ++entry.distance, idx = (idx + 1) & mask)
+  {
+    auto slot = &map->slots[idx];
+    if (!slot->distance)
+    {
+      *slot = entry;
+      map->count++;
+      return;
+    }
+    if (slot->distance < entry.distance)
+    {
+      /* rob the richer entry of its slot, and carry on placing it instead */
+      auto displaced = *slot;
+      *slot = entry;
+      entry = displaced;
+    }
+  }
+}
+
+static void
+resize_map (map_t map, size_t new_capacity)
 {
-  auto map_length = array$length (map->buckets);
   $strict_assert (
-    !(map_length & (map_length - 1)),
-    "Hashmap bucket count must be a power of two");
-  return map_length;
+    !(new_capacity & (new_capacity - 1)),
+    "Map capacity must be a power of two");
+  $trace_debug (
+    "resizing map (%p) from %zu slots to %zu",
+    map, map->capacity, new_capacity);
+  auto old_slots = map->slots;
+  auto old_capacity = map->capacity;
+  map->slots = arena$alloc (
+    map->arena, sizeof (struct map_slot) * new_capacity);
+  map->capacity = new_capacity;
+  map->count = 0;
+  for (size_t i = 0; i < old_capacity; ++i)
+  {
+    if (old_slots[i].distance)
+      insert_slot (map, old_slots[i]);
+  }
+  arena$dealloc (map->arena, old_slots);
 }
 
-struct map_bucket*
-get_bucket_for_key (map_t map, hashnum_t key)
+static void
+maybe_grow_map (map_t map)
 {
-  return (struct map_bucket *)array$at (
-    map->buckets, key & (get_bucket_count (map) - 1));
+  if ((map->count + 1) * MAP_LOAD_FACTOR_DEN
+      > map->capacity * MAP_LOAD_FACTOR_NUM)
+    resize_map (map, map->capacity * 2);
 }
 
 map_t
 map$new (void)
 {
-  map_t map = $chk_allocty (map_t);
-  map->buckets = array$new (sizeof (struct map_bucket));
-  array$allocopts (map->buckets, (struct array_allocopts){
-    .min_nmemb = NR_INITIAL_BUCKETS,
-    .alloc_nmemb_increment = 1,
-  });
-  $map_for_each_bucket ($, map, bucket)
-  {
-    $.bucket->entries = array$new (sizeof (struct map_bucket_entry));
-    array$allocopts ($.bucket->entries, (struct array_allocopts){
-      .alloc_nmemb_increment = 1,
-      .trim_nmemb_threshold = 1
-    });
-  }
+  return map$new_in (NULL);
+}
+
+map_t
+map$new_in (arena_t arena)
+{
+  map_t map = arena$alloc (arena, sizeof (*map));
+  map->arena = arena;
+  map->capacity = MAP_INITIAL_CAPACITY;
+  map->slots = arena$alloc (arena, sizeof (struct map_slot) * map->capacity);
   return map;
 }
 
 void
 map$free (map_t map)
 {
-  $map_for_each_bucket ($, map, bucket)
-  {
-    array$free ($.bucket->entries);
-  }
-  array$free (map->buckets);
-  $chk_free (map);
+  arena$dealloc (map->arena, map->slots);
+  arena$dealloc (map->arena, map);
 }
 
 void
 map$set (map_t map, hashnum_t key, void* value)
 {
-  auto bucket = get_bucket_for_key (map, key);
-  struct map_bucket_entry entry = { .hashnum = key, .value = value };
-  if (array$length (bucket->entries))  /* maybe collision? */
+  auto slot = find_slot (map, key);
+  if (slot != NULL)
   {
-    $bucket_for_each_entry ($, bucket, entry)
-    {
-      if ($.entry->hashnum == key)
-      {
-        $trace_debug ("updating map entry for key: %zu", key);
-        $.entry->value = value;
-        return;
-      }
-    }
-    $trace_debug ("creating map entry for key: %zu (with collision)", key);
+    $trace_debug ("updating map entry for key: %zu", key);
+    slot->value = value;
+    return;
   }
-  else
-    $trace_debug ("creating map entry for key: %zu", key);
-  $trace_verbose (
-    "map entry for value %p, in bucket %zu",
-    value, key & (get_bucket_count (map) - 1));
-  array$append (bucket->entries, &entry);
+  $trace_debug ("creating map entry for key: %zu", key);
+  maybe_grow_map (map);
+  insert_slot (map, (struct map_slot){ .hashnum = key, .value = value });
 }
 
 void*
 map$get (map_t map, hashnum_t key)
 {
- auto bucket = get_bucket_for_key (map, key);
- $bucket_for_each_entry ($, bucket, entry)
- {
-  if ($.entry->hashnum == key)
-    return $.entry->value;
- }
- return NULL;
+  auto slot = find_slot (map, key);
+  return (slot != NULL)? slot->value: NULL;
 }
 
 void
 map$remove (map_t map, hashnum_t key)
 {
-  auto bucket = get_bucket_for_key (map, key);
-  if (array$is_empty (bucket->entries))
-    goto not_found;
-  $bucket_for_each_entry ($, bucket, entry)
+  auto slot = find_slot (map, key);
+  if (slot == NULL)
   {
-    if ($.entry->hashnum == key)
-    {
-      array$remove (bucket->entries, $.i);
-      $trace_debug ("removed key from map: %zu", key);
-      return;
-    }
+    $trace_debug ("tried to remove key that doesn't exist: %zu", key);
+    return;
   }
 
-not_found:
-  $trace_debug ("tried to remove key that doesn't exist: %zu", key);
+  /* shift the rest of the probe sequence back by one, rather than leaving
+   * a tombstone
+   */
+  auto mask = map->capacity - 1;
+  size_t idx = slot - map->slots;
+  for (;;)
+  {
+    auto next = &map->slots[(idx + 1) & mask];
+    if (next->distance <= 1)
+      break;
+    map->slots[idx] = *next;
+    map->slots[idx].distance--;
+    idx = (idx + 1) & mask;
+  }
+  map->slots[idx] = (struct map_slot){ 0 };
+  map->count--;
+  $trace_debug ("removed key from map: %zu", key);
 }
 
 bool
 map$contains (map_t map, hashnum_t key)
 {
-  return map$get (map, key) != NULL;
+  return find_slot (map, key) != NULL;
 }
 
 bool
 map$is_empty (map_t map)
 {
-  $map_for_each_bucket ($, map, bucket)
-  {
-    if (!array$is_empty ($.bucket->entries))
-      return false;
-  }
-  return true;
+  return !map->count;
+}
+
+size_t
+map$length (map_t map)
+{
+  return map->count;
 }
 
 void
 map$for_each_pair (map_t map, iter_foreach_t callback, void* data)
 {
-  $map_for_each_bucket ($, map, bucket)
+  /* NB: the map mustn't be modified from within `callback` */
+  for (size_t i = 0; i < map->capacity; ++i)
   {
-    $bucket_for_each_entry ($$, $.bucket, entry)
-    {
-      if (!callback (data, $$.entry->hashnum, $$.entry->value))
-        return;
-    }
+    auto slot = &map->slots[i];
+    if (slot->distance && !callback (data, slot->hashnum, slot->value))
+      return;
   }
 }
\ No newline at end of file
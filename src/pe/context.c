@@ -62,6 +62,33 @@ validate_nt_headers (pe_context_t pe_context)
   return true;
 }
 
+static int
+compare_section_rva (const void* a, const void* b)
+{
+  auto section_a = *(struct image_section_header* const *)a;
+  auto section_b = *(struct image_section_header* const *)b;
+  if (section_a->virtual_address < section_b->virtual_address)
+    return -1;
+  return section_a->virtual_address > section_b->virtual_address;
+}
+
+static uint32_t
+get_directory_rva (pe_context_t pe_context, uint8_t index)
+{
+  auto entry = pe_context->nt_header.optional_header.data_directory[index];
+  auto section = pe$find_section_by_rva (pe_context, entry.virtual_address);
+  if (!entry.virtual_address || (section == NULL))
+  {
+    $trace_debug (
+      "invalid entry descriptor RVA: %" PRIx32, entry.virtual_address);
+    return 0;
+  }
+  $trace_debug (
+    "found directory (%" PRIu8 ") table in: %.8s (rva. %" PRIx32 ")",
+    index, section->name, entry.virtual_address);
+  return entry.virtual_address;
+}
+
 static pe_context_t
 pe$alloc (void)
 {
@@ -74,6 +101,20 @@ pe$from_file (FILE* file, uint8_t flags)
   $trace_debug ("allocating PE context from file");
   auto pe_context = pe$alloc ();
   pe_context->stream = file;
+
+  if (flags & PE_CONTEXT_MAP_IMAGE)
+  {
+    size_t image_size;
+    auto image_base = platform_map_file (file, &image_size);
+    if (image_base == NULL)
+      $trace_debug ("failed to map image, falling back to stream reads");
+    else
+    {
+      $trace_debug ("mapped image (%zu bytes) at %p", image_size, image_base);
+      pe_context->image.base = image_base;
+      pe_context->image.size = image_size;
+    }
+  }
   
   if (!$read_type (pe_context->dos_header, file))
     goto fail;
@@ -138,6 +179,8 @@ pe$from_file (FILE* file, uint8_t flags)
     section_headers, nr_sections, sizeof (struct image_section_header));
   $chk_free (section_headers);
 
+  pe_context->sorted_sections = array$new (
+    sizeof (struct image_section_header *));
   $array_for_each (
     $, pe_context->section_headers, struct image_section_header, section)
   {
@@ -147,44 +190,51 @@ pe$from_file (FILE* file, uint8_t flags)
       $.section->name, $.section->pointer_to_raw_data,
       $.section->virtual_address, $.section->size_of_raw_data,
       $.section->misc.virtual_size);
+    array$append (pe_context->sorted_sections, &$.section);
   }
+  array$sort (pe_context->sorted_sections, compare_section_rva);
 
   if (flags & PE_CONTEXT_LOAD_IMPORT_DIRECTORY)
   {
-    auto import_offset = pe$find_directory_fileoffs (
+    auto import_rva = get_directory_rva (
       pe_context, IMAGE_DIRECTORY_ENTRY_IMPORT);
-    if (!import_offset)
+    if (!import_rva)
     {
-      $trace_err ("failed to find import directory file offset");
+      $trace_err ("failed to find import directory");
       goto fail;
     }
-    if (!pe$read_import_descriptors (pe_context, import_offset))
+    if (!pe$read_import_descriptors (pe_context, import_rva))
       goto fail;
   }
 
   if (flags & PE_CONTEXT_LOAD_EXPORT_DIRECTORY)
   {
-    auto export_offset = pe$find_directory_fileoffs (
+    /* NB: not an error, executables rarely export anything */
+    auto export_rva = get_directory_rva (
       pe_context, IMAGE_DIRECTORY_ENTRY_EXPORT);
-    if (!export_offset)
-    {
-      $trace_err ("failed to find export directory file offset");
-      goto fail;
-    }
-    if (!pe$read_export_descriptors (pe_context, export_offset))
+    if (!pe$read_export_descriptors (pe_context, export_rva))
       goto fail;
   }
 
   if (flags & PE_CONTEXT_LOAD_TLS_DIRECTORY)
   {
-    auto tls_offset = pe$find_directory_fileoffs (
+    /* NB: not an error either, most images have no TLS */
+    auto tls_rva = get_directory_rva (
       pe_context, IMAGE_DIRECTORY_ENTRY_TLS);
-    if (!tls_offset)
-    {
-      $trace_err ("failed to find TLS directory file offset");
+    if (!pe$read_tls_directory (pe_context, tls_rva))
       goto fail;
-    }
-    if (!pe$read_tls_directory (pe_context, tls_offset))
+  }
+
+  if (flags & PE_CONTEXT_LOAD_EXCEPTION_DIRECTORY)
+  {
+    /* NB: not an error, images made up only of leaf functions have none */
+    auto exception_rva = get_directory_rva (
+      pe_context, IMAGE_DIRECTORY_ENTRY_EXCEPTION);
+    auto exception_size = exception_rva
+      ? optional_header->data_directory[IMAGE_DIRECTORY_ENTRY_EXCEPTION].size
+      : 0;
+    if (!pe$read_exception_directory (
+        pe_context, exception_rva, exception_size))
       goto fail;
   }
 
@@ -199,16 +249,21 @@ void
 pe$free (pe_context_t pe_context)
 {
   $trace_debug ("freeing PE context");
-  array$free (pe_context->tls.callbacks);
+  if (pe_context->tls.callbacks != NULL)
+    array$free (pe_context->tls.callbacks);
   if (pe_context->exports.functions != NULL)
+    array$free (pe_context->exports.functions);
+  if (pe_context->exports.by_name != NULL)
   {
     $array_for_each (
-      $, pe_context->exports.functions, struct export_func_entry, entry)
+      $, pe_context->exports.by_name, struct export_name_entry, entry)
     {
-      $chk_free ($.entry->func_name);
+      $chk_free ($.entry->name);
     }
+    array$free (pe_context->exports.by_name);
   }
-  array$free (pe_context->exports.functions);
+  if (pe_context->exports.by_rva != NULL)
+    array$free (pe_context->exports.by_rva);
   if (pe_context->imports != NULL)
   {
     $array_for_each ($, pe_context->imports, struct import_entry, entry)
@@ -221,8 +276,15 @@ pe$free (pe_context_t pe_context)
       array$free ($.entry->functions);
       $chk_free ($.entry->module_name);
     }
+    array$free (pe_context->imports);
   }
-  array$free (pe_context->imports);
-  array$free (pe_context->section_headers);
+  if (pe_context->runtime_functions != NULL)
+    array$free (pe_context->runtime_functions);
+  if (pe_context->sorted_sections != NULL)
+    array$free (pe_context->sorted_sections);
+  if (pe_context->section_headers != NULL)
+    array$free (pe_context->section_headers);
+  if (pe$is_image_mapped (pe_context))
+    platform_unmap_file ((void *)pe_context->image.base, pe_context->image.size);
   $chk_free (pe_context);
 }
\ No newline at end of file
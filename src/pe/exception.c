@@ -0,0 +1,152 @@
+#include "pe/context.h"
+
+static int
+compare_runtime_function (const void* a, const void* b)
+{
+  const struct image_runtime_function_entry* function_a = a;
+  const struct image_runtime_function_entry* function_b = b;
+  if (function_a->begin_address < function_b->begin_address)
+    return -1;
+  return function_a->begin_address > function_b->begin_address;
+}
+
+bool
+pe$read_exception_directory (
+  pe_context_t pe_context, uint32_t rva, uint32_t size)
+{
+  auto nr_functions = size / sizeof (struct image_runtime_function_entry);
+  if (!nr_functions)
+  {
+    pe_context->runtime_functions = array$new (
+      sizeof (struct image_runtime_function_entry));
+    return true;
+  }
+
+  /* NB: the table is read in one go, it's one entry per non-leaf function
+   *     and so easily the largest directory in the image
+   */
+  auto table = pe$read_sized (
+    pe_context, rva,
+    nr_functions * sizeof (struct image_runtime_function_entry));
+  if (table == NULL)
+  {
+    $trace_debug ("failed to read exception directory from file");
+    return false;
+  }
+  pe_context->runtime_functions = array$from_existing (
+    table, nr_functions, sizeof (struct image_runtime_function_entry));
+  $chk_free (table);
+
+  /* the table should already be sorted, but nothing guarantees it */
+  array$sort (pe_context->runtime_functions, compare_runtime_function);
+  $trace_debug ("read %zu runtime functions", nr_functions);
+  return true;
+}
+
+const struct image_runtime_function_entry*
+pe$find_runtime_function (pe_context_t pe_context, uint64_t rva)
+{
+  auto functions = pe_context->runtime_functions;
+  if (functions == NULL)
+    return NULL;
+
+  /* binary search for the last function starting at or before `rva` */
+  size_t lo = 0, hi = array$length (functions);
+  while (lo < hi)
+  {
+    auto mid = lo + (hi - lo) / 2;
+    const struct image_runtime_function_entry* function = array$at (
+      functions, mid);
+    if (function->begin_address <= rva)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (!lo)
+    return NULL;
+  const struct image_runtime_function_entry* function = array$at (
+    functions, lo - 1);
+  if (rva < function->end_address)
+    return function;
+  return NULL;
+}
+
+bool
+pe$is_runtime_function_chained (
+  pe_context_t pe_context, const struct image_runtime_function_entry* function)
+{
+  struct image_unwind_info info;
+  if (!pe$read_rva (
+      pe_context, &info, function->unwind_info_address, sizeof (info)))
+    return false;
+  return info.flags & UNW_FLAG_CHAININFO;
+}
+
+bool
+pe$get_unwind_alloc_size (
+  pe_context_t pe_context, const struct image_runtime_function_entry* function,
+  uint64_t* size)
+{
+  struct image_unwind_info info;
+  union image_unwind_code codes[UINT8_MAX];
+  auto rva = function->unwind_info_address;
+  if (!pe$read_rva (pe_context, &info, rva, sizeof (info))
+      || (info.count_of_codes && !pe$read_rva (
+        pe_context, codes, rva + sizeof (info),
+        info.count_of_codes * sizeof (*codes))))
+  {
+    $trace_debug ("failed to read unwind info at RVA: %" PRIx32, rva);
+    return false;
+  }
+
+  /* NB: chained entries only describe their own part of the prologue */
+  *size = 0;
+  for (uint8_t i = 0; i < info.count_of_codes; ++i)
+  {
+    auto code = codes[i];
+    switch (code.unwind_op)
+    {
+      case UWOP_ALLOC_SMALL:
+        *size += code.op_info * 8 + 8;
+        break;
+      case UWOP_ALLOC_LARGE:
+        if (!code.op_info && (i + 1 < info.count_of_codes))
+        {
+          *size += codes[i + 1].frame_offset * 8;
+          i += 1;
+        }
+        else if (code.op_info && (i + 2 < info.count_of_codes))
+        {
+          *size += codes[i + 1].frame_offset
+            | ((uint32_t)codes[i + 2].frame_offset << 16);
+          i += 2;
+        }
+        else
+        {
+          $trace_debug ("truncated unwind code at RVA: %" PRIx32, rva);
+          return false;
+        }
+        break;
+      /* NB: op 6 is an epilog code of a single slot from version 2 on, and
+       *     the old two-slot UWOP_SAVE_XMM before that
+       */
+      case UWOP_EPILOG:
+        if (info.version < 2)
+          i += 1;
+        break;
+      /* operations using extra slots */
+      case UWOP_SAVE_NONVOL:
+      case UWOP_SAVE_XMM128:
+        i += 1;
+        break;
+      case UWOP_SAVE_NONVOL_FAR:
+      case UWOP_SPARE_CODE:
+      case UWOP_SAVE_XMM128_FAR:
+        i += 2;
+        break;
+      default:
+        break;
+    }
+  }
+  return true;
+}
\ No newline at end of file
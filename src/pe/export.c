@@ -1,98 +1,204 @@
+#include <string.h>
+
 #include "pe/context.h"
 
+#define EXPORT_UNUSED_SLOT (UINT32_MAX)
 
+static int
+compare_export_name (const void* a, const void* b)
+{
+  auto entry_a = (const struct export_name_entry *)a;
+  auto entry_b = (const struct export_name_entry *)b;
+  return strcmp (entry_a->name, entry_b->name);
+}
 
-bool
-pe$read_export_descriptors (pe_context_t pe_context, uint32_t offset)
+static int
+compare_export_rva (const void* a, const void* b)
+{
+  auto entry_a = *(struct export_func_entry* const *)a;
+  auto entry_b = *(struct export_func_entry* const *)b;
+  if (entry_a->rva.address < entry_b->rva.address)
+    return -1;
+  return entry_a->rva.address > entry_b->rva.address;
+}
+
+static char*
+read_export_name (pe_context_t pe_context, uint32_t rva_name)
 {
-  auto file = pe_context->stream;
-  fseek (file, offset, SEEK_SET);
+  char* name = $chk_calloc (sizeof (char), MAX_FUNCNAME_LENGTH);
+  auto nread = pe$read_asciz_rva (
+    pe_context, name, MAX_FUNCNAME_LENGTH, rva_name);
+  if (!nread)
+  {
+    $chk_free (name);
+    return NULL;
+  }
+  return $chk_reallocarray (name, sizeof (char), nread + 1);
+}
 
+bool
+pe$read_export_descriptors (pe_context_t pe_context, uint32_t rva)
+{
   auto exports = &pe_context->exports;
   exports->functions = array$new (
     sizeof (struct export_func_entry));
+  exports->by_name = array$new (sizeof (struct export_name_entry));
+  exports->by_rva = array$new (sizeof (struct export_func_entry *));
+  if (!rva)
+    return true;
 
-  if (!$read_type (exports->descriptor, file))
+  if (!pe$read_rva (
+      pe_context, &exports->descriptor, rva, sizeof (exports->descriptor)))
   {
     $trace_debug ("failed to read export directory from file");
     return false;
   }
 
-  auto offs_eat = pe$find_fileoffs_by_rva (
-    pe_context, NULL, exports->descriptor.address_of_functions);
-  auto offs_names = pe$find_fileoffs_by_rva (
-    pe_context, NULL, exports->descriptor.address_of_names);
-  auto offs_ordinals = pe$find_fileoffs_by_rva (
-    pe_context, NULL, exports->descriptor.address_of_name_ordinals);
-  if (!offs_eat || !offs_names || !offs_ordinals)
+  auto nr_functions = exports->descriptor.number_of_functions;
+  auto nr_names = exports->descriptor.number_of_names;
+  if (!nr_functions)
+    return true;
+
+  /* NB: the tables are read whole up front, most are small but some DLLs
+   *     export thousands of functions
+   */
+  union image_export_table_entry* eat = NULL;
+  uint32_t* names = NULL;
+  uint16_t* ordinals = NULL;
+  uint32_t* slot_to_function = NULL;
+  bool success = false;
+
+  eat = (union image_export_table_entry *)pe$read_sized (
+    pe_context, exports->descriptor.address_of_functions,
+    nr_functions * sizeof (*eat));
+  if (nr_names)
+  {
+    names = (uint32_t *)pe$read_sized (
+      pe_context, exports->descriptor.address_of_names,
+      nr_names * sizeof (*names));
+    ordinals = (uint16_t *)pe$read_sized (
+      pe_context, exports->descriptor.address_of_name_ordinals,
+      nr_names * sizeof (*ordinals));
+  }
+  if ((eat == NULL) || (nr_names && ((names == NULL) || (ordinals == NULL))))
+  {
+    $trace_debug ("failed to read export address tables from file");
+    goto cleanup;
+  }
+
+  /* forwarders point back into the export directory itself */
+  auto directory = pe_context->nt_header.optional_header.data_directory[
+    IMAGE_DIRECTORY_ENTRY_EXPORT];
+  slot_to_function = $chk_calloc (sizeof (*slot_to_function), nr_functions);
+  for (uint32_t i = 0; i < nr_functions; ++i)
   {
-    $trace_debug ("failed to find export address table RVAs");
-    goto fail;
+    /* skip unused slots of the export address table */
+    slot_to_function[i] = EXPORT_UNUSED_SLOT;
+    if (!eat[i].address)
+      continue;
+
+    struct export_func_entry entry = {
+      .func_name = NULL,
+      .ordinal = i,
+      .rva = eat[i],
+      .is_forwarded = (eat[i].address >= directory.virtual_address)
+        && (eat[i].address
+          < (uint64_t)directory.virtual_address + directory.size),
+    };
+    slot_to_function[i] = array$length (exports->functions);
+    array$append (exports->functions, &entry);
   }
 
-  for (size_t i = 0; i < exports->descriptor.number_of_functions; ++i)
+  /* every name is indexed, an aliased function is named after the first of
+   * its names in the table.
+   * NB: these point into `functions`, which is never grown again
+   */
+  for (uint32_t j = 0; j < nr_names; ++j)
   {
-    struct export_func_entry entry;
-    fseek (
-      file, offs_eat + i * sizeof (struct image_export_table_entry), SEEK_SET);
-    if (!$read_type (entry.rva, file))
+    if ((ordinals[j] >= nr_functions)
+        || (slot_to_function[ordinals[j]] == EXPORT_UNUSED_SLOT))
     {
-      $trace_debug ("failed to read export table entry from file");
-      goto fail;
+      $trace_debug ("export name #%" PRIu32 " has no function", j);
+      continue;
     }
-    entry.ordinal = i;
-    
-    /* find the export name pointer, if it exists */
-    for (size_t j = 0; j < exports->descriptor.number_of_names; ++j)
+    struct export_name_entry name_entry = {
+      .name = read_export_name (pe_context, names[j]),
+      .function = array$at (
+        exports->functions, slot_to_function[ordinals[j]]),
+    };
+    if (name_entry.name == NULL)
     {
-      fseek (file, offs_ordinals + i * sizeof (uint16_t), SEEK_SET);
-      uint16_t ordinal;
-      if (!$read_type (ordinal, file))
-      {
-        $trace_debug ("failed to read export table ordinal");
-        goto fail;
-      }
-      if (ordinal != i)
-        continue;
-      fseek (file, offs_names + j * sizeof (uint32_t), SEEK_SET);
-      uint32_t rva_name;
-      if (!$read_type (rva_name, file))
-      {
-        $trace_debug ("failed to read export table entry name pointer");
-        goto fail;
-      }
-      auto offs_name = pe$find_fileoffs_by_rva (pe_context, NULL, rva_name);
-      if (!offs_name)
-      {
-        $trace_debug ("failed to find export table entry name");
-        goto fail;
-      }
-      entry.func_name = $chk_calloc (sizeof (char), MAX_FUNCNAME_LENGTH);
-      fseek (file, offs_name, SEEK_SET);
-      auto nread = read_asciz (
-        entry.func_name, MAX_FUNCNAME_LENGTH, file);
-      if (!nread)
-      {
-        $trace_debug ("failed to read export function name");
-        $chk_free (entry.func_name);
-        goto fail;
-      }
-      entry.func_name = $chk_reallocarray (
-        entry.func_name, sizeof (char), nread);
-      $trace_debug (
-        "read exported function (+%" PRIx32 ")#%" PRIu16 ": %s",
-        entry.rva.address, entry.ordinal, entry.func_name);
+      $trace_debug ("failed to read export function name");
+      goto cleanup;
     }
-    if (entry.func_name == NULL)
-      $trace_debug (
-        "read exported function (+%" PRIx32 ")#%" PRIu16 ": (no-name)",
-        entry.rva.address, entry.ordinal);
-    array$append (exports->functions, &entry);
+    array$append (exports->by_name, &name_entry);
+    if (name_entry.function->func_name == NULL)
+      name_entry.function->func_name = name_entry.name;
+    $trace_debug (
+      "read exported function (+%" PRIx32 ")#%" PRIu16 ": %s",
+      name_entry.function->rva.address, name_entry.function->ordinal,
+      name_entry.name);
   }
-  return true;
 
-fail:
-  array$free (exports->functions);
-  exports->functions = NULL;
-  return false;
+  $array_for_each ($, exports->functions, struct export_func_entry, entry)
+    array$append (exports->by_rva, &$.entry);
+  array$sort (exports->by_name, compare_export_name);
+  array$sort (exports->by_rva, compare_export_rva);
+  success = true;
+
+cleanup:
+  $chk_free (eat);
+  $chk_free (names);
+  $chk_free (ordinals);
+  $chk_free (slot_to_function);
+  return success;
+}
+
+const struct export_func_entry*
+pe$find_export_by_name (pe_context_t pe_context, const char* name)
+{
+  auto by_name = pe_context->exports.by_name;
+  if (by_name == NULL)
+    return NULL;
+
+  size_t lo = 0, hi = array$length (by_name);
+  while (lo < hi)
+  {
+    auto mid = lo + (hi - lo) / 2;
+    auto entry = (struct export_name_entry *)array$at (by_name, mid);
+    auto cmp = strcmp (name, entry->name);
+    if (!cmp)
+      return entry->function;
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return NULL;
+}
+
+const struct export_func_entry*
+pe$find_export_by_rva (pe_context_t pe_context, uint64_t rva)
+{
+  auto by_rva = pe_context->exports.by_rva;
+  if (by_rva == NULL)
+    return NULL;
+
+  /* binary search for the first export at or after `rva` */
+  size_t lo = 0, hi = array$length (by_rva);
+  while (lo < hi)
+  {
+    auto mid = lo + (hi - lo) / 2;
+    auto entry = *(struct export_func_entry **)array$at (by_rva, mid);
+    if (entry->rva.address < rva)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == array$length (by_rva))
+    return NULL;
+  auto entry = *(struct export_func_entry **)array$at (by_rva, lo);
+  if (entry->rva.address != rva)
+    return NULL;
+  return entry;
 }
\ No newline at end of file
@@ -8,7 +8,6 @@ static bool
 resolve_imports (
   pe_context_t pe_context, struct import_entry* ientry)
 {
-  auto file = pe_context->stream;
   ientry->functions = array$new (sizeof (struct import_func_entry));
   auto module = platform_load_library (ientry->module_name);
   if (module == NULL)
@@ -17,23 +16,22 @@ resolve_imports (
     return false;
   }
   ientry->module_base = module;
-  auto ilt_offset = pe$find_fileoffs_by_rva (
-    pe_context, NULL, ientry->descriptor.original_first_thunk);
-  if (!ilt_offset)
+  auto ilt_rva = ientry->descriptor.original_first_thunk;
+  if (pe$find_section_by_rva (pe_context, ilt_rva) == NULL)
   {
     $trace_debug (
-      "failed to find ILT offset for module: %s", ientry->module_name);
+      "failed to find ILT for module: %s", ientry->module_name);
     return false;
   }
 
   auto ilt_increment = pe$get_image_maxsize (pe_context);
   for (size_t i = 0;; ++i)
   {
-    fseek (file, ilt_offset + i * ilt_increment, SEEK_SET);
     struct import_func_entry fentry = { 0 };
 
     uint64_t ilt_entry;
-    auto nread = pe$read_maxint (&ilt_entry, pe_context); 
+    auto nread = pe$read_maxint_rva (
+      pe_context, &ilt_entry, ilt_rva + i * ilt_increment);
     if (!nread)
     {
       $trace_debug (
@@ -52,22 +50,17 @@ resolve_imports (
     }
     else
     {
-      auto hint_offset = pe$find_fileoffs_by_rva(
-        pe_context, NULL, ilt_entry & 0x7fffffff);
-      if (!hint_offset)
-      {
-        $trace_debug ("failed to find hint/name offset for ILT");
-        continue;
-      }
+      auto hint_rva = ilt_entry & 0x7fffffff;
       struct image_import_by_name hint_name;
-      fseek (file, hint_offset, SEEK_SET);
-      if (!$read_type (hint_name, file))
+      if (!pe$read_rva (pe_context, &hint_name, hint_rva, sizeof (hint_name)))
       {
-        $trace_debug ("failed to read hint/name offset for ILT");
+        $trace_debug ("failed to read hint/name for ILT");
         continue;
       }
       char* func_name = $chk_calloc (sizeof (char), MAX_FUNCNAME_LENGTH);
-      auto nread = read_asciz (func_name, MAX_FUNCNAME_LENGTH, file);
+      auto nread = pe$read_asciz_rva (
+        pe_context, func_name, MAX_FUNCNAME_LENGTH,
+        hint_rva + sizeof (hint_name));
       if (!nread)
       {
         $trace_debug ("failed to read function name from hint/name");
@@ -98,38 +91,31 @@ resolve_imports (
 }
 
 bool
-pe$read_import_descriptors (pe_context_t pe_context, uint32_t offset)
+pe$read_import_descriptors (pe_context_t pe_context, uint32_t rva)
 {
-  auto file = pe_context->stream;
   pe_context->imports = array$new (sizeof (struct import_entry));
   for (size_t i = 0;; ++i)
   {
-    fseek (
-      file, offset + i * sizeof (struct image_import_descriptor), SEEK_SET);
     struct import_entry ientry = { 0 };
-    if (!$read_type (ientry.descriptor, file))
+    if (!pe$read_rva (
+        pe_context, &ientry.descriptor,
+        rva + i * sizeof (struct image_import_descriptor),
+        sizeof (ientry.descriptor)))
     {
       $trace_debug ("failed to read import descriptor");
       goto fail;
     }
     if (!ientry.descriptor.characteristics)
       break; /* sentinel descriptor */
-    auto name_offset = pe$find_fileoffs_by_rva (
-      pe_context, NULL, ientry.descriptor.name);
-    if (!name_offset)
-    {
-      $trace_debug ("failed to find IDT name");
-      continue; 
-    }
     ientry.module_name = $chk_calloc (sizeof (char), MAX_PATH);
-    fseek (file, name_offset, SEEK_SET);
-    auto nread = read_asciz (ientry.module_name, MAX_PATH, file);
+    auto nread = pe$read_asciz_rva (
+      pe_context, ientry.module_name, MAX_PATH, ientry.descriptor.name);
     if (!nread)
     {
       $trace_debug ("failed to read IDT name");
       goto entry_fail;
     }
-    ientry.module_name = $chk_realloc (ientry.module_name, nread);
+    ientry.module_name = $chk_realloc (ientry.module_name, nread + 1);
     ientry.iat_rva = ientry.descriptor.first_thunk;
     if (!resolve_imports (pe_context, &ientry))
     {
@@ -147,5 +133,6 @@ entry_fail:
 
 fail:
   array$free (pe_context->imports);
+  pe_context->imports = NULL;
   return false;
 }
\ No newline at end of file
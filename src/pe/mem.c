@@ -2,6 +2,7 @@
 #include "pe/context.h"
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 bool
 pe$is_image_x64 (pe_context_t pe_context)
@@ -56,16 +57,44 @@ pe$read_maxint (uint64_t* into, pe_context_t pe_context)
   return nread;
 }
 
+#define ZERO_FILL_VIEW_SIZE (4096)
+
+/* backs views into the zero-filled tail of sections whose virtual size
+ * exceeds their raw size
+ */
+static const uint8_t g_zero_fill[ZERO_FILL_VIEW_SIZE];
+
+uint32_t
+pe$get_section_virtual_size (struct image_section_header* section)
+{
+  /* some linkers leave the virtual size empty, in which case the loader
+   * maps the raw size
+   */
+  if (!section->misc.virtual_size)
+    return section->size_of_raw_data;
+  return section->misc.virtual_size;
+}
+
 struct image_section_header*
 pe$find_section_by_rva (pe_context_t pe_context, uint64_t rva)
 {
-  $array_for_each (
-    $, pe_context->section_headers, struct image_section_header, section)
+  /* binary search for the last section starting at or before `rva` */
+  auto sections = pe_context->sorted_sections;
+  size_t lo = 0, hi = array$length (sections);
+  while (lo < hi)
   {
-    if (($.section->virtual_address <= rva)
-        && (rva < $.section->virtual_address + $.section->misc.virtual_size))
-      return $.section;
+    auto mid = lo + (hi - lo) / 2;
+    auto section = *(struct image_section_header **)array$at (sections, mid);
+    if (section->virtual_address <= rva)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  if (!lo)
+    return NULL;
+  auto section = *(struct image_section_header **)array$at (sections, lo - 1);
+  if (rva < section->virtual_address + pe$get_section_virtual_size (section))
+    return section;
   return NULL;
 }
 
@@ -114,9 +143,160 @@ pe$get_ptrsize (pe_context_t pe_context)
   return pe$is_image_x64 (pe_context)? sizeof (uint64_t): sizeof (uint32_t);
 }
 
+bool
+pe$is_image_mapped (pe_context_t pe_context)
+{
+  return pe_context->image.base != NULL;
+}
+
+const uint8_t*
+pe$view_rva (pe_context_t pe_context, uint64_t rva, uint64_t* len)
+{
+  /* borrowed from the mapping, so it must not outlive the PE context. `len`
+   * receives how many bytes are contiguously viewable from `rva`, which is
+   * bounded by the containing section; views into the zero-filled tail of a
+   * section are further capped to `ZERO_FILL_VIEW_SIZE`
+   */
+  if (!pe$is_image_mapped (pe_context))
+    return NULL;
+  auto section = pe$find_section_by_rva (pe_context, rva);
+  if (section == NULL)
+  {
+    $trace_debug ("failed to find section for RVA: %" PRIx64, rva);
+    return NULL;
+  }
+  uint64_t offset = rva - section->virtual_address;
+  uint64_t virtual_size = pe$get_section_virtual_size (section);
+  uint64_t raw_size = section->size_of_raw_data;
+  uint64_t raw_start = section->pointer_to_raw_data;
+
+  /* truncated images keep whatever part of the section made it to disk */
+  if (raw_start >= pe_context->image.size)
+    raw_size = 0;
+  else
+    raw_size = $min (raw_size, pe_context->image.size - raw_start);
+
+  if (offset < raw_size)
+  {
+    *len = $min (raw_size, virtual_size) - offset;
+    return pe_context->image.base + raw_start + offset;
+  }
+  *len = $min (virtual_size - offset, (uint64_t)ZERO_FILL_VIEW_SIZE);
+  return g_zero_fill;
+}
+
+const uint8_t*
+pe$view_sized (pe_context_t pe_context, uint64_t rva, uint64_t size)
+{
+  uint64_t len;
+  auto view = pe$view_rva (pe_context, rva, &len);
+  if ((view == NULL) || (len < size))
+  {
+    $trace_debug (
+      "view of %" PRIu64 " bytes at RVA %" PRIx64 " exceeds section bounds",
+      size, rva);
+    return NULL;
+  }
+  return view;
+}
+
+bool
+pe$read_rva (pe_context_t pe_context, void* into, uint64_t rva, uint64_t size)
+{
+  if (!pe$is_image_mapped (pe_context))
+  {
+    auto offset = pe$find_fileoffs_by_rva (pe_context, NULL, rva);
+    if (!offset)
+    {
+      $trace_debug ("failed to find file offset for RVA: %" PRIx64, rva);
+      return false;
+    }
+    fseek (pe_context->stream, offset, SEEK_SET);
+    return read_sized (into, size, pe_context->stream);
+  }
+
+  uint8_t* dst = into;
+  while (size)
+  {
+    uint64_t len;
+    auto view = pe$view_rva (pe_context, rva, &len);
+    if (view == NULL)
+      return false;
+    len = $min (len, size);
+    memcpy (dst, view, len);
+    dst += len;
+    rva += len;
+    size -= len;
+  }
+  return true;
+}
+
+int
+pe$read_maxint_rva (pe_context_t pe_context, uint64_t* into, uint64_t rva)
+{
+  uint64_t n = 0;
+  if (!pe$read_rva (pe_context, &n, rva, pe$get_image_maxsize (pe_context)))
+  {
+    $trace_debug ("failed to read integer at RVA: %" PRIx64, rva);
+    return 0;
+  }
+  *into = n;
+  return 1;
+}
+
+int
+pe$read_asciz_rva (
+  pe_context_t pe_context, char* into, ssize_t max_length, uint64_t rva)
+{
+  if (!pe$is_image_mapped (pe_context))
+  {
+    auto offset = pe$find_fileoffs_by_rva (pe_context, NULL, rva);
+    if (!offset)
+    {
+      $trace_debug ("failed to find file offset for RVA: %" PRIx64, rva);
+      return 0;
+    }
+    fseek (pe_context->stream, offset, SEEK_SET);
+    return read_asciz (into, max_length, pe_context->stream);
+  }
+
+  /* same contract as `read_asciz`: returns the string length, excluding the
+   * terminator, or `max_length` if none was found
+   */
+  ssize_t nread = 0;
+  while (nread < max_length)
+  {
+    uint64_t len;
+    auto view = pe$view_rva (pe_context, rva + nread, &len);
+    if (view == NULL)
+    {
+      $trace_debug ("failed to read string from image");
+      return 0;
+    }
+    len = $min (len, (uint64_t)(max_length - nread));
+    const uint8_t* terminator = memchr (view, 0, len);
+    if (terminator != NULL)
+    {
+      memcpy (into + nread, view, terminator - view + 1);
+      return nread + (terminator - view);
+    }
+    memcpy (into + nread, view, len);
+    nread += len;
+  }
+  return nread;
+}
+
 uint8_t*
 pe$read_sized (pe_context_t pe_context, uint64_t rva, uint64_t size)
 {
+  if (pe$is_image_mapped (pe_context))
+  {
+    auto view = pe$view_sized (pe_context, rva, size);
+    if (view == NULL)
+      return NULL;
+    return memcpy ($chk_calloc (sizeof (char), size), view, size);
+  }
+
   auto file = pe_context->stream;
   auto offset = pe$find_fileoffs_by_rva (pe_context, NULL, rva);
   if (!offset)
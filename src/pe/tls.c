@@ -1,38 +1,46 @@
 #include "pe/context.h"
 
 bool
-pe$read_tls_directory (pe_context_t pe_context, uint32_t offset)
+pe$read_tls_directory (pe_context_t pe_context, uint32_t rva)
 {
-  auto file = pe_context->stream;
   auto tls = &pe_context->tls;
+  auto ptrsize = pe$get_image_maxsize (pe_context);
 
   pe_context->tls.callbacks = array$new (sizeof (uint64_t));
+  if (!rva)
+    return true;
 
-  fseek (file, offset, SEEK_SET);
-  if (!pe$read_maxint (&tls->descriptor.raw_data_start, pe_context)
-      || !pe$read_maxint (&tls->descriptor.raw_data_end, pe_context)
-      || !pe$read_maxint (&tls->descriptor.index_address, pe_context)
-      || !pe$read_maxint (&tls->descriptor.callback_address, pe_context)
-      || !$read_type (tls->descriptor.size_of_zero_fill, file)
-      || !$read_type (tls->descriptor.characteristics, file))
+  if (!pe$read_maxint_rva (pe_context, &tls->descriptor.raw_data_start, rva)
+      || !pe$read_maxint_rva (
+        pe_context, &tls->descriptor.raw_data_end, rva + ptrsize)
+      || !pe$read_maxint_rva (
+        pe_context, &tls->descriptor.index_address, rva + 2 * ptrsize)
+      || !pe$read_maxint_rva (
+        pe_context, &tls->descriptor.callback_address, rva + 3 * ptrsize)
+      || !pe$read_rva (
+        pe_context, &tls->descriptor.size_of_zero_fill, rva + 4 * ptrsize,
+        sizeof (tls->descriptor.size_of_zero_fill))
+      || !pe$read_rva (
+        pe_context, &tls->descriptor.characteristics, rva + 4 * ptrsize
+          + sizeof (tls->descriptor.size_of_zero_fill),
+        sizeof (tls->descriptor.characteristics)))
   {
     $trace_debug ("failed to read TLS descriptor from file");
     return false;
   }
-  auto callback_offset = pe$find_fileoffs_by_rva (
-    pe_context, NULL, pe$va_to_rva (
-      pe_context, tls->descriptor.callback_address));
-  if (!callback_offset)
+  auto callback_rva = pe$va_to_rva (
+    pe_context, tls->descriptor.callback_address);
+  if (pe$find_section_by_rva (pe_context, callback_rva) == NULL)
   {
-    $trace_debug ("failed to find TLS callback address table offset");
+    $trace_debug ("failed to find TLS callback address table");
     return false;
   }
 
-  fseek (file, callback_offset, SEEK_SET);
-  for (;;)
+  for (size_t i = 0;; ++i)
   {
     uint64_t callback_address;
-    if (!$read_type (callback_address, file))
+    if (!pe$read_maxint_rva (
+        pe_context, &callback_address, callback_rva + i * ptrsize))
     {
       $trace_debug ("failed to read TLS callback address");
       goto fail;
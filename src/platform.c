@@ -4,6 +4,7 @@
   || defined(__CYGWIN__)
 # include <Windows.h>
 # include <winnt.h>
+# include <io.h>
 
   void*
   platform_load_library (const char* name)
@@ -28,4 +29,57 @@
   {
     return NtCurrentTeb ();
   }
+
+  void*
+  platform_map_file (FILE* file, size_t* size)
+  {
+    /* pipes and character devices can't be mapped, the caller is expected
+     * to fall back to reading the stream
+     */
+    HANDLE handle = (HANDLE)_get_osfhandle (_fileno (file));
+    LARGE_INTEGER file_size;
+    if ((handle == INVALID_HANDLE_VALUE)
+        || (GetFileType (handle) != FILE_TYPE_DISK)
+        || !GetFileSizeEx (handle, &file_size) || !file_size.QuadPart)
+      return NULL;
+    HANDLE mapping = CreateFileMappingA (
+      handle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL)
+      return NULL;
+    void* base = MapViewOfFile (mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle (mapping);
+    if (base != NULL)
+      *size = file_size.QuadPart;
+    return base;
+  }
+
+  void
+  platform_unmap_file (void* base, size_t size)
+  {
+    (void)size;
+    UnmapViewOfFile (base);
+  }
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+
+  void*
+  platform_map_file (FILE* file, size_t* size)
+  {
+    struct stat st;
+    int fd = fileno (file);
+    if (fstat (fd, &st) || !S_ISREG (st.st_mode) || !st.st_size)
+      return NULL;
+    void* base = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+      return NULL;
+    *size = st.st_size;
+    return base;
+  }
+
+  void
+  platform_unmap_file (void* base, size_t size)
+  {
+    munmap (base, size);
+  }
 #endif
\ No newline at end of file
@@ -20,6 +20,7 @@ void
 stack$free (stack_t stack)
 {
   $chk_free (stack->base);
+  $chk_free (stack);
 }
 
 stack_t